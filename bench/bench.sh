@@ -0,0 +1,133 @@
+#!/bin/sh
+#
+# Benchmark suite
+#
+# Runs every case against minishell and, when installed, dash and bash,
+# printing one CSV row per case and shell (see benchrun.c for columns).
+# Results are also written to $BENCH_OUT (default: bench_results.csv).
+#
+# Usage: bench.sh [path/to/minishell]
+#
+# Pipeline cases also run minishell with PIPE_SIZE=max, reported as shell
+# "minishell+pipe=max", and a repeated pipeline with PIPE_SIZE=adaptive so
+# the learned capacity shows up from the second repetition on.
+#
+# builtin_test_external runs /usr/bin/test by path, giving the cost of
+# the same check as a process launch next to the builtin_test case.
+#
+# Tunables: BENCH_RUNS (runs per case), BENCH_BYTES (pipeline payload),
+# BENCH_ONLY (run only cases whose name starts with it)
+#
+
+MINISHELL=${1:-./minishell}
+BENCHDIR=$(dirname "$0")
+RUN="$BENCHDIR/benchrun"
+OUT=${BENCH_OUT:-bench_results.csv}
+RUNS=${BENCH_RUNS:-20}
+BYTES=${BENCH_BYTES:-67108864}
+ONLY=${BENCH_ONLY:-}
+REPEAT=8
+TRUE_BIN=$(for d in /usr/bin /bin; do [ -x "$d/true" ] && echo "$d/true" && break; done)
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT INT TERM
+
+SHELLS="$MINISHELL"
+for sh in dash bash; do
+    path=$(command -v "$sh" 2>/dev/null) && SHELLS="$SHELLS $path"
+done
+
+# Synthetic parser input: short, quoted and operator-heavy lines
+awk 'BEGIN {
+    for (i = 0; i < 10000; i++) {
+        if (i % 4 == 0) print "ls -la /tmp/dir" i;
+        else if (i % 4 == 1) print "echo \"quoted " i " words\" '\''single quoted'\'' tail";
+        else if (i % 4 == 2) print "make all && ./prog" i " || echo failed; grep x file | sort | uniq -c";
+        else print "cmd" i " a b c d e f g h i j k l m n o p q r s t u v w x y z";
+    }
+}' > "$WORK/parse.sh"
+
+# External command launches
+awk -v t="$TRUE_BIN" 'BEGIN { for (i = 0; i < 200; i++) print t }' > "$WORK/launch.sh"
+
+# Builtin throughput
+awk 'BEGIN { for (i = 0; i < 10000; i++) print "echo hello world from the benchmark " i }' > "$WORK/echo.sh"
+awk 'BEGIN { for (i = 0; i < 1000; i++) print "env" }' > "$WORK/env.sh"
+awk 'BEGIN { for (i = 0; i < 10000; i++) print "true" }' > "$WORK/true.sh"
+awk 'BEGIN { for (i = 0; i < 10000; i++) print "[ -f /etc/passwd ]" }' > "$WORK/test.sh"
+awk 'BEGIN { for (i = 0; i < 10000; i++) print "printf \"%s %d\\n\" line " i }' > "$WORK/printf.sh"
+
+# The same test run as a program, for the per-call cost of a launch
+TEST_BIN=$(for d in /usr/bin /bin; do [ -x "$d/test" ] && echo "$d/test" && break; done)
+awk -v t="$TEST_BIN" 'BEGIN { for (i = 0; i < 200; i++) print t " -f /etc/passwd" }' > "$WORK/test_external.sh"
+
+# Mixed 10k-line script: mostly builtins, one external launch in ten
+awk -v t="$TRUE_BIN" 'BEGIN {
+    for (i = 0; i < 10000; i++) {
+        if (i % 10 == 0) print t " " i;
+        else if (i % 10 < 5) print "echo line " i;
+        else if (i % 10 < 8) print "export BENCH_VAR" (i % 50) "=" i;
+        else print "cd /tmp";
+    }
+}' > "$WORK/script10k.sh"
+
+# run_case label ops bytes command...
+run_case() {
+    label=$1 ops=$2 bytes=$3
+    shift 3
+    case $label in "$ONLY"*) ;; *) return ;; esac
+    for sh in $SHELLS; do
+        "$RUN" -n "$RUNS" -l "$label" -s "$(basename "$sh")" -o "$ops" -b "$bytes" \
+            -- "$sh" "$@" || true
+    done
+}
+
+# run_pipe_size setting label ops bytes command... (minishell only)
+run_pipe_size() {
+    size=$1 label=$2 ops=$3 bytes=$4
+    shift 4
+    case $label in "$ONLY"*) ;; *) return ;; esac
+    PIPE_SIZE=$size "$RUN" -n "$RUNS" -l "$label" -s "$(basename "$MINISHELL")+pipe=$size" \
+        -o "$ops" -b "$bytes" -- "$MINISHELL" "$@" || true
+}
+
+# pipeline_cmd stages -> "head -c N /dev/zero | cat | ... | wc -c"
+pipeline_cmd() {
+    cmd="head -c $BYTES /dev/zero"
+    i=2
+    while [ "$i" -lt "$1" ]; do
+        cmd="$cmd | cat"
+        i=$((i + 1))
+    done
+    echo "$cmd | wc -c"
+}
+
+# pipeline_repeat stages -> the pipeline $REPEAT times in one shell
+pipeline_repeat() {
+    cmd=$(pipeline_cmd "$1")
+    i=1
+    while [ "$i" -lt "$REPEAT" ]; do
+        cmd="$cmd; $(pipeline_cmd "$1")"
+        i=$((i + 1))
+    done
+    echo "$cmd"
+}
+
+{
+    "$RUN" -H
+    run_case parse_lines 10000 0 -n "$WORK/parse.sh"
+    run_case true_launch 200 0 "$WORK/launch.sh"
+    for stages in 2 4 8; do
+        run_case "pipeline_${stages}" 1 "$BYTES" -c "$(pipeline_cmd "$stages")"
+        run_pipe_size max "pipeline_${stages}" 1 "$BYTES" -c "$(pipeline_cmd "$stages")"
+    done
+    run_case pipeline_4_repeat "$REPEAT" $((BYTES * REPEAT)) -c "$(pipeline_repeat 4)"
+    run_pipe_size adaptive pipeline_4_repeat "$REPEAT" $((BYTES * REPEAT)) -c "$(pipeline_repeat 4)"
+    run_case builtin_echo 10000 0 "$WORK/echo.sh"
+    run_case builtin_env 1000 0 "$WORK/env.sh"
+    run_case builtin_true 10000 0 "$WORK/true.sh"
+    run_case builtin_test 10000 0 "$WORK/test.sh"
+    run_case builtin_test_external 200 0 "$WORK/test_external.sh"
+    run_case builtin_printf 10000 0 "$WORK/printf.sh"
+    run_case script_10k 10000 0 "$WORK/script10k.sh"
+} | tee "$OUT"
@@ -0,0 +1,150 @@
+/*
+ * Benchmark runner
+ *
+ * Runs a command repeatedly with stdin and stdout on /dev/null and prints
+ * one CSV row of wall-time percentiles. Times can be divided by an
+ * operation count (-o) to report per-operation cost, and a byte count (-b)
+ * adds median throughput in MB/s.
+ *
+ * Usage: benchrun [-n runs] [-w warmup] [-o ops] [-b bytes] [-H]
+ *                 -l case -s shell -- command [args...]
+ *
+ * -H prints the CSV header instead of running anything. A command that
+ * fails to start or exits non-zero produces no row and exit status 1.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#define CSV_HEADER "case,shell,runs,ops,min_us,p50_us,p90_us,p99_us,max_us,mean_us,mb_per_s"
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Run the command once. Returns elapsed ns, or -1 on failure.
+ */
+static long long run_once(char **argv) {
+    posix_spawn_file_actions_t fa;
+    pid_t pid;
+    int status;
+
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    long long start = now_ns();
+    int err = posix_spawnp(&pid, argv[0], &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    if (err != 0) {
+        return -1;
+    }
+
+    if (waitpid(pid, &status, 0) == -1) {
+        return -1;
+    }
+    long long elapsed = now_ns() - start;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return elapsed;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n runs] [-w warmup] [-o ops] [-b bytes] [-H] "
+            "-l case -s shell -- command [args...]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int runs = 20, warmup = 2, opt;
+    double ops = 1;
+    long long bytes = 0;
+    const char *label = NULL, *shell = NULL;
+
+    while ((opt = getopt(argc, argv, "n:w:o:b:l:s:H")) != -1) {
+        switch (opt) {
+        case 'n': runs = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        case 'o': ops = atof(optarg); break;
+        case 'b': bytes = atoll(optarg); break;
+        case 'l': label = optarg; break;
+        case 's': shell = optarg; break;
+        case 'H':
+            printf("%s\n", CSV_HEADER);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!label || !shell || optind >= argc || runs <= 0 || ops <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char **cmd = argv + optind;
+    long long *samples = malloc(runs * sizeof(long long));
+    if (!samples) {
+        perror("malloc");
+        return 1;
+    }
+
+    for (int i = 0; i < warmup; i++) {
+        if (run_once(cmd) < 0) {
+            fprintf(stderr, "%s/%s: command failed\n", label, shell);
+            free(samples);
+            return 1;
+        }
+    }
+
+    double total = 0;
+    for (int i = 0; i < runs; i++) {
+        samples[i] = run_once(cmd);
+        if (samples[i] < 0) {
+            fprintf(stderr, "%s/%s: command failed\n", label, shell);
+            free(samples);
+            return 1;
+        }
+        total += samples[i];
+    }
+
+    qsort(samples, runs, sizeof(long long), cmp_ll);
+
+    /* Per-operation microseconds */
+    double scale = 1000.0 * ops;
+    long long p50 = samples[runs / 2];
+
+    printf("%s,%s,%d,%.0f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,", label, shell, runs, ops,
+           samples[0] / scale, p50 / scale,
+           samples[(runs * 90) / 100] / scale,
+           samples[(runs * 99) / 100] / scale,
+           samples[runs - 1] / scale,
+           total / runs / scale);
+    if (bytes > 0) {
+        printf("%.1f", bytes / (p50 / 1e9) / (1024.0 * 1024.0));
+    }
+    printf("\n");
+
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Parser microbenchmark
+ *
+ * Links the shell's parser (shell.c built with -DMINISHELL_NO_MAIN) and
+ * command chain code directly and times parse_command_line() followed by
+ * free_command_chain() on several corpora. Allocations are counted by
+ * wrapping malloc/calloc/realloc/free at link time (-Wl,--wrap=...), so
+ * only calls made from the shell's own objects are counted.
+ *
+ * Usage: parsebench [-c cpu] [-i iterations] [-w warmup]
+ *
+ * Results are printed as CSV: corpus,lines,ns_per_line,allocs_per_line,
+ * bytes_per_line. The benchmark pins itself to one CPU (the one it starts
+ * on unless -c is given) and runs warmup passes before measuring.
+ */
+
+#include "../shell.h"
+
+#include <sched.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static unsigned long long alloc_count;
+static unsigned long long alloc_bytes;
+
+void *__wrap_malloc(size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    alloc_count++;
+    alloc_bytes += n * size;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    __real_free(ptr);
+}
+
+#define CORPUS_LINES 1024
+
+typedef struct {
+    const char *name;
+    char *lines[CORPUS_LINES];
+} corpus_t;
+
+/**
+ * Build one corpus line for a given style
+ */
+static char *make_line(const char *style, int i) {
+    char buf[MAX_COMMAND_LENGTH];
+
+    if (strcmp(style, "short") == 0) {
+        snprintf(buf, sizeof(buf), "ls -l%d", i % 10);
+    } else if (strcmp(style, "long") == 0) {
+        int len = snprintf(buf, sizeof(buf), "cmd%d", i);
+        for (int a = 0; a < 40 && len < (int)sizeof(buf) - 16; a++) {
+            len += snprintf(buf + len, sizeof(buf) - len, " argument%d", a);
+        }
+    } else if (strcmp(style, "quoted") == 0) {
+        snprintf(buf, sizeof(buf),
+                 "echo \"hello world %d\" 'single quoted text' \"a b c\" 'x y z'", i);
+    } else {
+        snprintf(buf, sizeof(buf),
+                 "make && ./t%d || echo fail; ls | grep x | sort | uniq -c && true || false", i);
+    }
+
+    return shell_strdup(buf);
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Parse and free every line of a corpus once
+ */
+static void run_pass(corpus_t *corpus) {
+    for (int i = 0; i < CORPUS_LINES; i++) {
+        command_chain_t *chain = parse_command_line(corpus->lines[i]);
+        free_command_chain(chain);
+    }
+}
+
+int main(int argc, char **argv) {
+    static const char *styles[] = {"short", "long", "quoted", "operators"};
+    int cpu = -1, iterations = 200, warmup = 20, opt;
+
+    while ((opt = getopt(argc, argv, "c:i:w:")) != -1) {
+        switch (opt) {
+        case 'c': cpu = atoi(optarg); break;
+        case 'i': iterations = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-c cpu] [-i iterations] [-w warmup]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    /* Pin to one CPU so migrations don't pollute the numbers */
+    if (cpu < 0) {
+        cpu = sched_getcpu();
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity");
+    }
+
+    printf("corpus,lines,ns_per_line,allocs_per_line,bytes_per_line\n");
+
+    for (size_t s = 0; s < sizeof(styles) / sizeof(styles[0]); s++) {
+        corpus_t corpus;
+        corpus.name = styles[s];
+        for (int i = 0; i < CORPUS_LINES; i++) {
+            corpus.lines[i] = make_line(styles[s], i);
+        }
+
+        for (int i = 0; i < warmup; i++) {
+            run_pass(&corpus);
+        }
+
+        unsigned long long count0 = alloc_count, bytes0 = alloc_bytes;
+        long long start = now_ns();
+        for (int i = 0; i < iterations; i++) {
+            run_pass(&corpus);
+        }
+        long long elapsed = now_ns() - start;
+
+        double lines = (double)iterations * CORPUS_LINES;
+        printf("%s,%.0f,%.1f,%.2f,%.1f\n", corpus.name, lines,
+               elapsed / lines,
+               (alloc_count - count0) / lines,
+               (alloc_bytes - bytes0) / lines);
+
+        for (int i = 0; i < CORPUS_LINES; i++) {
+            free(corpus.lines[i]);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Startup latency benchmark
+ *
+ * Measures, for each shell given on the command line:
+ *   exec_to_first_cmd - spawn `sh -c 'echo x'` until its first output byte
+ *   exec_to_exit      - spawn `sh -c true` until it has been reaped
+ *
+ * Shells that cannot be spawned are skipped, so `dash` and `bash` can be
+ * listed unconditionally. Results are printed as CSV in microseconds.
+ *
+ * Usage: startup [-n runs] [-w warmup] shell...
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Run `shell -c script` once. Returns elapsed ns until the first byte of
+ * output (wait_output) or until exit, or -1 if the shell can't be spawned.
+ */
+static long long run_once(const char *shell, const char *script, int wait_output) {
+    char *argv[] = {(char *)shell, "-c", (char *)script, NULL};
+    posix_spawn_file_actions_t fa;
+    int pipe_fd[2];
+    pid_t pid;
+    long long start, elapsed = -1;
+    int status;
+
+    if (pipe(pipe_fd) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, pipe_fd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&fa, pipe_fd[0]);
+    posix_spawn_file_actions_addclose(&fa, pipe_fd[1]);
+
+    start = now_ns();
+    if (posix_spawnp(&pid, shell, &fa, NULL, argv, environ) != 0) {
+        posix_spawn_file_actions_destroy(&fa);
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        return -1;
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    close(pipe_fd[1]);
+
+    if (wait_output) {
+        char c;
+        if (read(pipe_fd[0], &c, 1) == 1) {
+            elapsed = now_ns() - start;
+        }
+    }
+
+    waitpid(pid, &status, 0);
+    if (!wait_output) {
+        elapsed = now_ns() - start;
+    }
+    close(pipe_fd[0]);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+        return -1;
+    }
+    return elapsed;
+}
+
+/**
+ * Benchmark one metric for one shell and print a CSV row
+ */
+static int bench(const char *shell, const char *metric, const char *script,
+                 int wait_output, int runs, int warmup) {
+    long long *samples = malloc(runs * sizeof(long long));
+    if (!samples) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (int i = 0; i < warmup; i++) {
+        if (run_once(shell, script, wait_output) < 0) {
+            free(samples);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < runs; i++) {
+        samples[i] = run_once(shell, script, wait_output);
+        if (samples[i] < 0) {
+            free(samples);
+            return -1;
+        }
+    }
+
+    qsort(samples, runs, sizeof(long long), cmp_ll);
+    printf("%s,%s,%d,%.1f,%.1f,%.1f,%.1f\n", shell, metric, runs,
+           samples[0] / 1000.0,
+           samples[runs / 2] / 1000.0,
+           samples[(runs * 90) / 100] / 1000.0,
+           samples[(runs * 99) / 100] / 1000.0);
+
+    free(samples);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int runs = 1000, warmup = 50, opt;
+
+    while ((opt = getopt(argc, argv, "n:w:")) != -1) {
+        switch (opt) {
+        case 'n': runs = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n runs] [-w warmup] shell...\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind >= argc || runs <= 0) {
+        fprintf(stderr, "usage: %s [-n runs] [-w warmup] shell...\n", argv[0]);
+        return 2;
+    }
+
+    printf("shell,metric,runs,min_us,p50_us,p90_us,p99_us\n");
+    for (int i = optind; i < argc; i++) {
+        if (bench(argv[i], "exec_to_first_cmd", "echo x", 1, runs, warmup) < 0 ||
+            bench(argv[i], "exec_to_exit", "true", 0, runs, warmup) < 0) {
+            fprintf(stderr, "%s: skipped (not runnable)\n", argv[i]);
+        }
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -8,7 +8,7 @@ int builtin_cd(char **args, shell_context_t *ctx) {
     
     if (!args || !args[0]) {
         /* No argument, go to HOME */
-        dir = getenv("HOME");
+        dir = (char *)var_get(ctx->vars, "HOME");
         if (!dir) {
             fprintf(stderr, "cd: HOME not set\n");
             return 1;
@@ -22,11 +22,8 @@ int builtin_cd(char **args, shell_context_t *ctx) {
         return 1;
     }
     
-    /* Update current directory in context */
-    if (getcwd(ctx->current_dir, sizeof(ctx->current_dir)) == NULL) {
-        perror("getcwd");
-        return 1;
-    }
+    /* Invalidate cached directory; re-resolved lazily when next needed */
+    ctx->current_dir[0] = '\0';
     
     return 0;
 }
@@ -35,18 +32,16 @@ int builtin_cd(char **args, shell_context_t *ctx) {
  * Built-in pwd command
  */
 int builtin_pwd(char **args, shell_context_t *ctx) {
-    char cwd[MAX_PATH];
-    
     (void)args; /* Suppress unused parameter warning */
-    (void)ctx;  /* Suppress unused parameter warning */
     
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        printf("%s\n", cwd);
-        return 0;
-    } else {
+    const char *dir = get_current_dir(ctx);
+    if (!dir) {
         perror("pwd");
         return 1;
     }
+    
+    printf("%s\n", dir);
+    return 0;
 }
 
 /**
@@ -81,18 +76,38 @@ int builtin_echo(char **args, shell_context_t *ctx) {
     return 0;
 }
 
+/**
+ * Built-in true command
+ */
+int builtin_true(char **args, shell_context_t *ctx) {
+    (void)args; /* Suppress unused parameter warning */
+    (void)ctx;
+    
+    return 0;
+}
+
+/**
+ * Built-in false command
+ */
+int builtin_false(char **args, shell_context_t *ctx) {
+    (void)args; /* Suppress unused parameter warning */
+    (void)ctx;
+    
+    return 1;
+}
+
 /**
  * Built-in env command
  */
 int builtin_env(char **args, shell_context_t *ctx) {
     (void)args; /* Suppress unused parameter warning */
-    (void)ctx;  /* Suppress unused parameter warning */
     
-    if (!environ) {
+    char **envp = var_envp(ctx->vars);
+    if (!envp) {
         return 1;
     }
     
-    for (char **env = environ; *env; env++) {
+    for (char **env = envp; *env; env++) {
         printf("%s\n", *env);
     }
     
@@ -109,7 +124,201 @@ int builtin_exit(char **args, shell_context_t *ctx) {
         exit_code = atoi(args[0]);
     }
     
-    printf("exit\n");
+    if (ctx->interactive) {
+        printf("exit\n");
+    }
     cleanup_shell_context(ctx);
     exit(exit_code);
-}
\ No newline at end of file
+}
+
+/**
+ * Shared implementation of export and readonly: NAME[=VALUE]...
+ */
+static int set_attribute(char **args, shell_context_t *ctx, int flag, const char *cmd) {
+    int status = 0;
+    
+    if (!args || !args[0]) {
+        var_print(ctx->vars, flag, cmd);
+        return 0;
+    }
+    
+    for (int i = 0; args[i]; i++) {
+        char *eq = strchr(args[i], '=');
+        size_t len = eq ? (size_t)(eq - args[i]) : strlen(args[i]);
+        
+        if (!var_valid_name(args[i], len)) {
+            fprintf(stderr, "%s: `%s': not a valid identifier\n", cmd, args[i]);
+            status = 1;
+            continue;
+        }
+        
+        if (eq) {
+            *eq = '\0';
+            if (var_set(ctx->vars, args[i], eq + 1, flag) != 0) {
+                status = 1;
+            }
+            *eq = '=';
+        } else if (var_set(ctx->vars, args[i], NULL, flag) != 0) {
+            status = 1;
+        }
+    }
+    
+    return status;
+}
+
+/**
+ * Built-in export command
+ */
+int builtin_export(char **args, shell_context_t *ctx) {
+    return set_attribute(args, ctx, VAR_EXPORT, "export");
+}
+
+/**
+ * Built-in readonly command
+ */
+int builtin_readonly(char **args, shell_context_t *ctx) {
+    return set_attribute(args, ctx, VAR_READONLY, "readonly");
+}
+
+/**
+ * Built-in unset command
+ */
+int builtin_unset(char **args, shell_context_t *ctx) {
+    int status = 0;
+    
+    for (int i = 0; args && args[i]; i++) {
+        if (var_unset(ctx->vars, args[i]) != 0) {
+            status = 1;
+        }
+    }
+    
+    return status;
+}
+
+/*
+ * Builtin table. Adding a builtin means adding one entry here; the hash
+ * index below is derived from this list.
+ */
+static const builtin_t builtin_table[] = {
+    {"cd",       builtin_cd,       BUILTIN_SPECIAL},
+    {"pwd",      builtin_pwd,      0},
+    {"echo",     builtin_echo,     0},
+    {"env",      builtin_env,      0},
+    {"exit",     builtin_exit,     BUILTIN_SPECIAL},
+    {"export",   builtin_export,   BUILTIN_SPECIAL},
+    {"unset",    builtin_unset,    BUILTIN_SPECIAL},
+    {"readonly", builtin_readonly, BUILTIN_SPECIAL},
+    {"set",      builtin_set,      BUILTIN_SPECIAL},
+    {"stats",    builtin_stats,    0},
+    {"meminfo",  builtin_meminfo,  0},
+    {"jobs",     builtin_jobs,     0},
+    {"fg",       builtin_fg,       BUILTIN_SPECIAL},
+    {"bg",       builtin_bg,       BUILTIN_SPECIAL},
+    {"kill",     builtin_kill,     0},
+    {"timeout",  builtin_timeout,  0},
+    {"cat",      builtin_cat,      0},
+    {"tee",      builtin_tee,      0},
+    {"explain",  builtin_explain,  0},
+    {"true",     builtin_true,     0},
+    {"false",    builtin_false,    0},
+    {"test",     builtin_test,     0},
+    {"[",        builtin_bracket,  0},
+    {"printf",   builtin_printf,   0},
+};
+
+#define BUILTIN_COUNT ((int)(sizeof(builtin_table) / sizeof(builtin_table[0])))
+#define BUILTIN_SLOTS 128          /* Power of two, well above BUILTIN_COUNT */
+#define BUILTIN_MAX_SEED 65536
+
+/*
+ * Perfect hash index: slot -> table index + 1 (0 = empty). The seed is
+ * chosen once so that every name lands in its own slot, making a lookup
+ * one hash plus at most one strcmp.
+ */
+static unsigned char builtin_slots[BUILTIN_SLOTS];
+static unsigned int builtin_seed;
+static int builtin_index_state;    /* 0 = not built, 1 = perfect, -1 = scan */
+
+/**
+ * Seeded FNV-1a hash of a builtin name
+ */
+static unsigned int builtin_hash(const char *name, unsigned int seed) {
+    unsigned int hash = 2166136261u ^ seed;
+    
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    
+    return hash & (BUILTIN_SLOTS - 1);
+}
+
+/**
+ * Find a collision-free seed for the builtin table
+ */
+static void build_builtin_index(void) {
+    for (unsigned int seed = 0; seed < BUILTIN_MAX_SEED; seed++) {
+        int i;
+        
+        memset(builtin_slots, 0, sizeof(builtin_slots));
+        for (i = 0; i < BUILTIN_COUNT; i++) {
+            unsigned int slot = builtin_hash(builtin_table[i].name, seed);
+            if (builtin_slots[slot]) break;
+            builtin_slots[slot] = i + 1;
+        }
+        
+        if (i == BUILTIN_COUNT) {
+            builtin_seed = seed;
+            builtin_index_state = 1;
+            return;
+        }
+    }
+    
+    /* Unreachable for any sane table size; stay correct regardless */
+    builtin_index_state = -1;
+}
+
+/**
+ * Look up a builtin by name. Returns its id or BUILTIN_NONE.
+ */
+int lookup_builtin(const char *name) {
+    if (!name) return BUILTIN_NONE;
+    
+    if (builtin_index_state == 0) {
+        build_builtin_index();
+    }
+    
+    if (builtin_index_state < 0) {
+        for (int i = 0; i < BUILTIN_COUNT; i++) {
+            if (strcmp(name, builtin_table[i].name) == 0) return i;
+        }
+        return BUILTIN_NONE;
+    }
+    
+    int id = builtin_slots[builtin_hash(name, builtin_seed)] - 1;
+    if (id >= 0 && strcmp(name, builtin_table[id].name) == 0) {
+        return id;
+    }
+    
+    return BUILTIN_NONE;
+}
+
+/**
+ * Get a command's builtin id, resolving it on first use for nodes that
+ * were not built by the parser
+ */
+int cmd_builtin_id(cmd_node_t *cmd) {
+    if (cmd->builtin_id == BUILTIN_UNRESOLVED) {
+        cmd->builtin_id = lookup_builtin(cmd->command);
+    }
+    
+    return cmd->builtin_id;
+}
+
+/**
+ * Get a builtin table entry by id
+ */
+const builtin_t* get_builtin(int id) {
+    if (id < 0 || id >= BUILTIN_COUNT) return NULL;
+    return &builtin_table[id];
+}
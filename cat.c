@@ -0,0 +1,211 @@
+#include "shell.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+/*
+ * Built-in cat
+ *
+ * Copies files to stdout inside the shell, so `cat file | cmd` and
+ * `cat a b > out` start no process for cat, and moves the bytes without
+ * bringing them into user space where the kernel allows it:
+ *
+ *     file -> file    copy_file_range(2)
+ *     any  <-> pipe   splice(2)
+ *     file -> other   sendfile(2) (terminals, sockets, devices)
+ *
+ * Anything else, or a method the kernel or filesystem refuses, falls back
+ * to a read/write loop with a CAT_BUFFER buffer. Files that report a
+ * size of 0 (procfs, sysfs) are always read, since the zero-copy calls
+ * can see them as empty.
+ *
+ * In an interactive shell SIGINT is only delivered through the event
+ * loop, so the copy checks for ^C before every chunk, waiting for input
+ * that isn't a regular file to become readable first. It stops with
+ * status 130. Options other than -u are handed to the external cat, as
+ * is reading an interactive terminal, which the line discipline owns,
+ * and any run with a deadline (`timeout 1 cat`, TMOUT_CMD): deadlines
+ * are enforced by killing a child, which a builtin doesn't have.
+ */
+
+#define CAT_CHUNK (1L << 30)        /* Bytes asked for per zero-copy call */
+#define CAT_BUFFER (128 * 1024)     /* Read/write fallback buffer */
+
+typedef enum {
+    COPY_RANGE,                    /* copy_file_range() */
+    COPY_SPLICE,                   /* splice() */
+    COPY_SENDFILE,                 /* sendfile() */
+    COPY_BUFFER                    /* read() and write() */
+} copy_mode_t;
+
+/**
+ * Choose the cheapest copy method for a pair of descriptors
+ */
+static copy_mode_t copy_mode(const struct stat *in, const struct stat *out) {
+    int in_file = S_ISREG(in->st_mode) && in->st_size > 0;
+
+    if (S_ISREG(in->st_mode) && !in_file) return COPY_BUFFER;
+    if (S_ISFIFO(in->st_mode) || S_ISFIFO(out->st_mode)) return COPY_SPLICE;
+    if (in_file && S_ISREG(out->st_mode)) return COPY_RANGE;
+    if (in_file) return COPY_SENDFILE;
+    return COPY_BUFFER;
+}
+
+/**
+ * Whether a zero-copy call failed because the method doesn't apply to
+ * these descriptors (e.g. EXDEV across filesystems, EBADF for an
+ * O_APPEND output), rather than because of an I/O error
+ */
+static int copy_unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV ||
+           err == EOPNOTSUPP || err == EBADF;
+}
+
+/**
+ * Move up to CAT_CHUNK bytes with a zero-copy method. File offsets
+ * advance as with read/write, so a fallback can pick up where it stopped.
+ */
+static ssize_t copy_chunk(copy_mode_t mode, int in, int out) {
+    switch (mode) {
+    case COPY_RANGE:
+        return copy_file_range(in, NULL, out, NULL, CAT_CHUNK, 0);
+    case COPY_SPLICE:
+        return splice(in, NULL, out, NULL, CAT_CHUNK, SPLICE_F_MOVE);
+    case COPY_SENDFILE:
+        return sendfile(out, in, NULL, CAT_CHUNK);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+/**
+ * Write a whole buffer. Returns -1 on error. Shared with tee.c.
+ */
+int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Copy everything readable from in to out. Returns -1 with errno set on
+ * error, or with errno EINTR if ^C stopped it.
+ */
+static int copy_fd(shell_context_t *ctx, int in, int out, const struct stat *in_st,
+                   const struct stat *out_st) {
+    static char buffer[CAT_BUFFER];
+    copy_mode_t mode = copy_mode(in_st, out_st);
+    int wait_fd = S_ISREG(in_st->st_mode) ? -1 : in;
+
+    while (mode != COPY_BUFFER) {
+        if (event_interrupted(ctx, wait_fd)) {
+            errno = EINTR;
+            return -1;
+        }
+
+        ssize_t n = copy_chunk(mode, in, out);
+        if (n == 0) return 0;
+        if (n > 0) continue;
+        if (errno == EINTR) continue;
+        if (!copy_unsupported(errno)) return -1;
+
+        /* copy_file_range() is newer than sendfile() to a file */
+        mode = mode == COPY_RANGE ? COPY_SENDFILE : COPY_BUFFER;
+    }
+
+    for (;;) {
+        if (event_interrupted(ctx, wait_fd)) {
+            errno = EINTR;
+            return -1;
+        }
+
+        ssize_t n = read(in, buffer, sizeof(buffer));
+        if (n == 0) return 0;
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (write_all(out, buffer, n) == -1) return -1;
+    }
+}
+
+/**
+ * Built-in cat command: cat [-u] [file...], "-" meaning stdin
+ */
+int builtin_cat(char **args, shell_context_t *ctx) {
+    struct stat out_st;
+    int i = 0;
+
+    for (; args && args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(args[i], "-u") != 0) {
+            return execute_external_args("cat", args, ctx);
+        }
+    }
+    if (command_timeout(ctx, NULL) > 0) {
+        return execute_external_args("cat", args, ctx);
+    }
+
+    int reads_stdin = !args || !args[i];
+    for (int j = i; args && args[j]; j++) {
+        reads_stdin |= strcmp(args[j], "-") == 0;
+    }
+
+    if (reads_stdin && ctx->interactive && isatty(STDIN_FILENO)) {
+        return execute_external_args("cat", args, ctx);
+    }
+
+    /* Output written by other builtins comes first */
+    fflush(stdout);
+    if (fstat(STDOUT_FILENO, &out_st) == -1) {
+        perror("cat: stdout");
+        return 1;
+    }
+
+    int status = 0;
+    do {
+        const char *name = args && args[i] ? args[i] : "-";
+        int use_stdin = strcmp(name, "-") == 0;
+        int in = use_stdin ? STDIN_FILENO : open(name, O_RDONLY | O_CLOEXEC);
+        struct stat in_st;
+
+        if (in == -1 || fstat(in, &in_st) == -1) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+        } else if (S_ISDIR(in_st.st_mode)) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(EISDIR));
+            status = 1;
+        } else if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode) &&
+                   in_st.st_size > 0 && in_st.st_dev == out_st.st_dev &&
+                   in_st.st_ino == out_st.st_ino) {
+            /* cat a >> a would never finish */
+            fprintf(stderr, "cat: %s: input file is output file\n", name);
+            status = 1;
+        } else if (copy_fd(ctx, in, STDOUT_FILENO, &in_st, &out_st) == -1) {
+            if (errno == EINTR) {
+                status = EXIT_INTERRUPTED;
+            } else {
+                fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+                status = 1;
+            }
+        }
+
+        if (in > STDERR_FILENO) {
+            close(in);
+        }
+    } while (status != EXIT_INTERRUPTED && args && args[i] && args[++i]);
+
+    return status;
+}
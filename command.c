@@ -7,7 +7,7 @@ char* shell_strdup(const char *s) {
     if (!s) return NULL;
     
     size_t len = strlen(s) + 1;
-    char *dup = malloc(len);
+    char *dup = shell_malloc(len);
     if (!dup) {
         perror("malloc");
         return NULL;
@@ -21,7 +21,7 @@ char* shell_strdup(const char *s) {
  * Create a new command chain
  */
 command_chain_t* create_command_chain(void) {
-    command_chain_t *chain = malloc(sizeof(command_chain_t));
+    command_chain_t *chain = shell_malloc(sizeof(command_chain_t));
     if (!chain) {
         perror("malloc");
         return NULL;
@@ -38,7 +38,7 @@ command_chain_t* create_command_chain(void) {
  * Create a new command node
  */
 cmd_node_t* create_cmd_node(void) {
-    cmd_node_t *node = malloc(sizeof(cmd_node_t));
+    cmd_node_t *node = shell_malloc(sizeof(cmd_node_t));
     if (!node) {
         perror("malloc");
         return NULL;
@@ -50,10 +50,15 @@ cmd_node_t* create_cmd_node(void) {
     node->type = CMD_SIMPLE;
     node->next = NULL;
     node->input_file = NULL;
+    node->input_string = NULL;
     node->output_file = NULL;
     node->append_output = 0;
     node->background = 0;
+    node->builtin_id = BUILTIN_UNRESOLVED;
+    node->timed = 0;
+    node->path = NULL;
     
+    shell_mem.live_nodes++;
     return node;
 }
 
@@ -80,18 +85,21 @@ void add_command_to_chain(command_chain_t *chain, cmd_node_t *node) {
 void free_cmd_node(cmd_node_t *node) {
     if (!node) return;
     
-    free(node->command);
+    shell_free(node->command);
     
     if (node->args) {
         for (int i = 0; i < node->argc; i++) {
-            free(node->args[i]);
+            shell_free(node->args[i]);
         }
-        free(node->args);
+        shell_free(node->args);
     }
     
-    free(node->input_file);
-    free(node->output_file);
-    free(node);
+    shell_free(node->input_file);
+    shell_free(node->input_string);
+    shell_free(node->output_file);
+    shell_free(node->path);
+    shell_free(node);
+    shell_mem.live_nodes--;
 }
 
 /**
@@ -107,7 +115,7 @@ void free_command_chain(command_chain_t *chain) {
         current = next;
     }
     
-    free(chain);
+    shell_free(chain);
 }
 
 /**
@@ -116,7 +124,7 @@ void free_command_chain(command_chain_t *chain) {
 char** copy_args(char **args, int argc) {
     if (!args || argc == 0) return NULL;
     
-    char **new_args = malloc((argc + 1) * sizeof(char*));
+    char **new_args = shell_malloc((argc + 1) * sizeof(char*));
     if (!new_args) {
         perror("malloc");
         return NULL;
@@ -128,9 +136,9 @@ char** copy_args(char **args, int argc) {
             perror("shell_strdup");
             /* Clean up already allocated strings */
             for (int j = 0; j < i; j++) {
-                free(new_args[j]);
+                shell_free(new_args[j]);
             }
-            free(new_args);
+            shell_free(new_args);
             return NULL;
         }
     }
@@ -0,0 +1,585 @@
+#include "shell.h"
+
+#include <stdint.h>
+#include <poll.h>
+#include <linux/sched.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+
+/*
+ * Event loop
+ *
+ * An interactive shell waits on one epoll set holding a signalfd, the
+ * terminal while reading a line, and a pidfd for every child it is
+ * waiting for. SIGINT, SIGCHLD and SIGWINCH are blocked and read from the
+ * signalfd, so they are handled in normal context, never interrupt a
+ * system call and can't be lost between a check and a blocking wait.
+ * Children get the original signal mask back before exec.
+ *
+ * Children are started with fork_pidfd(), which gets the pidfd from
+ * clone3(CLONE_PIDFD) atomically with the fork, or from pidfd_open(2) on
+ * older kernels. Foreground children keep it in proc_stats_t.pidfd and are
+ * reaped by the executor once it turns readable. Jobs own their pidfds
+ * (see jobs.c) and are reaped here as soon as they exit. A foreground
+ * child with a deadline also has a timerfd in the set (see timeout.c).
+ * Kernels without pidfds fall back to blocking wait4().
+ *
+ * -c, script and piped-input runs don't set the loop up at all, which
+ * saves its system calls at startup. They poll() the pipeline's pidfds
+ * and timerfds directly. If epoll_wait() itself fails, the callers fall
+ * back to blocking wait4() and read().
+ */
+
+#define EV_SIGNAL 1                /* Signalfd readable */
+#define EV_INPUT  2                /* Terminal readable */
+#define EV_CHILD  3                /* Foreground child exited */
+#define EV_JOB    4                /* Background job exited */
+#define EV_TIMER  5                /* Foreground child's deadline passed */
+#define EV_ERROR  -1               /* epoll_wait() failed; don't retry */
+
+#define INPUT_CHUNK 4096
+
+/* epoll_event.data: kind in the top byte, fd in the next 24 bits, pid below */
+#define EV_PACK(kind, fd, pid) \
+    (((uint64_t)(kind) << 56) | ((uint64_t)((fd) & 0xffffff) << 32) | (uint32_t)(pid))
+#define EV_KIND(data) ((int)((data) >> 56))
+#define EV_FD(data)   ((int)(((data) >> 32) & 0xffffff))
+#define EV_PID(data)  ((pid_t)(uint32_t)(data))
+
+static sigset_t saved_mask;        /* Mask to restore in children */
+static int pidfd_supported = 1;
+static int clone3_usable = 1;      /* Cleared on ENOSYS or once threaded */
+
+/* Terminal input not yet returned as a line */
+static char *input_buf;
+static size_t input_len;
+static size_t input_capacity;
+
+/**
+ * Open a pidfd for a child, or return -1 if pidfds are unavailable
+ */
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    if (pidfd_supported) {
+        int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+        if (fd == -1 && errno == ENOSYS) {
+            pidfd_supported = 0;
+        }
+        return fd;
+    }
+#else
+    (void)pid;
+#endif
+    return -1;
+}
+
+/**
+ * Stop using raw clone3(). It skips libc's fork handlers, which is only
+ * safe while the shell has a single thread.
+ */
+void fork_pidfd_threaded(void) {
+    clone3_usable = 0;
+}
+
+/**
+ * fork() that also returns a pidfd for the child in *pidfd (-1 in the
+ * child, or if pidfds are unavailable). The pidfd is close-on-exec.
+ */
+pid_t fork_pidfd(int *pidfd) {
+    *pidfd = -1;
+
+#if defined(SYS_clone3) && defined(CLONE_PIDFD)
+    if (clone3_usable) {
+        struct clone_args args;
+        int fd = -1;
+
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_PIDFD;
+        args.pidfd = (uint64_t)(uintptr_t)&fd;
+        args.exit_signal = SIGCHLD;
+
+        long pid = syscall(SYS_clone3, &args, sizeof(args));
+        if (pid >= 0) {
+            *pidfd = pid > 0 ? fd : -1;
+            return (pid_t)pid;
+        }
+        if (errno != ENOSYS && errno != EPERM) return -1;
+
+        /* Old kernel, or a seccomp filter that rejects clone3 */
+        clone3_usable = 0;
+    }
+#endif
+
+    pid_t pid = fork();
+    if (pid > 0) {
+        *pidfd = open_pidfd(pid);
+    }
+    return pid;
+}
+
+/**
+ * Send a signal to a child through its pidfd, which can't hit a recycled
+ * pid. Falls back to kill() without one.
+ */
+int signal_child(pid_t pid, int pidfd, int sig) {
+#ifdef SYS_pidfd_send_signal
+    if (pidfd >= 0) {
+        return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+    }
+#else
+    (void)pidfd;
+#endif
+    return kill(pid, sig);
+}
+
+/**
+ * Publish the terminal size as COLUMNS and LINES
+ */
+static void update_window_size(shell_context_t *ctx) {
+    struct winsize ws;
+    char buf[16];
+
+    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) return;
+
+    snprintf(buf, sizeof(buf), "%u", ws.ws_col);
+    var_set(ctx->vars, "COLUMNS", buf, 0);
+    snprintf(buf, sizeof(buf), "%u", ws.ws_row);
+    var_set(ctx->vars, "LINES", buf, 0);
+}
+
+/**
+ * Set up the epoll set and signalfd for an interactive shell. Call once,
+ * after the fork server has been started so the helper keeps the original
+ * signal mask.
+ */
+int event_loop_init(shell_context_t *ctx) {
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGWINCH);
+    sigaddset(&mask, SIGINT);
+
+    ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctx->epoll_fd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    sigprocmask(SIG_BLOCK, &mask, &saved_mask);
+    ctx->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (ctx->signal_fd == -1) {
+        perror("signalfd");
+        sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+        close(ctx->epoll_fd);
+        ctx->epoll_fd = -1;
+        return -1;
+    }
+
+    struct epoll_event ev = {EPOLLIN, {.u64 = EV_PACK(EV_SIGNAL, ctx->signal_fd, 0)}};
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, ctx->signal_fd, &ev);
+
+    update_window_size(ctx);
+    return 0;
+}
+
+/**
+ * Undo the event loop's signal setup in a forked child
+ */
+void event_loop_child(void) {
+    sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+}
+
+/**
+ * Release the event loop's descriptors and buffers
+ */
+void event_loop_free(shell_context_t *ctx) {
+    if (ctx->signal_fd >= 0) {
+        close(ctx->signal_fd);
+        sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+    }
+    if (ctx->epoll_fd >= 0) {
+        close(ctx->epoll_fd);
+    }
+    ctx->signal_fd = -1;
+    ctx->epoll_fd = -1;
+
+    free(input_buf);
+    input_buf = NULL;
+    input_len = input_capacity = 0;
+}
+
+/**
+ * Watch a child's pidfd. job children are reaped by the loop itself and
+ * the loop takes over the pidfd; foreground ones are reported by
+ * event_wait_child(). Returns -1 if the child can't be watched: the
+ * caller then closes the pidfd and waits for the child the old way.
+ */
+int event_watch_child(shell_context_t *ctx, pid_t pid, int pidfd, int job) {
+    if (pidfd < 0) return -1;
+
+    /* Without a loop, foreground pidfds are polled by event_wait_child() */
+    if (ctx->epoll_fd < 0) return job ? -1 : 0;
+
+    struct epoll_event ev = {EPOLLIN, {.u64 = EV_PACK(job ? EV_JOB : EV_CHILD, pidfd, pid)}};
+    if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, pidfd, &ev) == -1) {
+        /* A stopped foreground child becoming a job is already watched */
+        if (errno != EEXIST) return -1;
+        return epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, pidfd, &ev);
+    }
+    return 0;
+}
+
+/**
+ * Arm a timerfd to fire once after ns nanoseconds
+ */
+static void set_timer(int fd, long long ns) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = ns / 1000000000LL;
+    its.it_value.tv_nsec = ns % 1000000000LL;
+    if (ns <= 0) {
+        its.it_value.tv_nsec = 1;  /* Zero would disarm it */
+    }
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+/**
+ * Give a watched foreground child a deadline: SIGTERM after timeout_ns,
+ * then SIGKILL grace_ns later if it is still running. The timerfd lives
+ * in ps->timer_fd until the child is reaped.
+ */
+int event_arm_timeout(shell_context_t *ctx, proc_stats_t *ps, long long timeout_ns,
+                      long long grace_ns) {
+    if (ps->pidfd < 0) return -1;
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    if (ctx->epoll_fd >= 0) {
+        struct epoll_event ev = {EPOLLIN, {.u64 = EV_PACK(EV_TIMER, fd, ps->pid)}};
+        if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    set_timer(fd, timeout_ns);
+    ps->timer_fd = fd;
+    ps->grace_ns = grace_ns;
+    return 0;
+}
+
+/**
+ * A child's deadline timer fired: TERM it the first time, KILL it after
+ * the grace period
+ */
+static void handle_timeout(shell_context_t *ctx, pid_t pid) {
+    for (int i = 0; i < ctx->proc_count; i++) {
+        proc_stats_t *ps = &ctx->proc_stats[i];
+        uint64_t expirations;
+
+        if (ps->pid != pid || ps->timer_fd < 0) continue;
+
+        if (read(ps->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            return;
+        }
+
+        if (!ps->timed_out) {
+            signal_child(ps->pid, ps->pidfd, SIGTERM);
+            /* A stopped child can't act on TERM */
+            signal_child(ps->pid, ps->pidfd, SIGCONT);
+            set_timer(ps->timer_fd, ps->grace_ns);
+        } else {
+            signal_child(ps->pid, ps->pidfd, SIGKILL);
+        }
+        ps->timed_out++;
+        return;
+    }
+}
+
+/**
+ * Drain the signalfd
+ */
+static void handle_signals_pending(shell_context_t *ctx) {
+    struct signalfd_siginfo si;
+
+    while (read(ctx->signal_fd, &si, sizeof(si)) == sizeof(si)) {
+        switch (si.ssi_signo) {
+        case SIGINT:
+            ctx->interrupted = 1;
+            break;
+        case SIGWINCH:
+            update_window_size(ctx);
+            break;
+        case SIGCHLD:
+            /* Without pidfds nothing else tells us about finished jobs */
+            if (!pidfd_supported) {
+                reap_background_jobs(ctx);
+            }
+            /* Stops and continues don't show on pidfds */
+            if (ctx->job_control) {
+                jobs_check_stopped(ctx);
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * Reap a background job whose pidfd became readable. The job owns the
+ * pidfd and closes it.
+ */
+static void handle_job_exit(shell_context_t *ctx, int fd, pid_t pid) {
+    int status;
+
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+    if (waitpid(pid, &status, WNOHANG) == pid) {
+        job_finished(ctx, pid, status);
+    }
+}
+
+/**
+ * Wait for the next event and handle the ones the loop owns. Returns the
+ * kind of event for the caller (EV_INPUT, or EV_CHILD with *pid set), 0
+ * if it was handled here, or EV_ERROR if epoll_wait() failed for a
+ * reason other than a signal. Waiting again would fail the same way.
+ */
+static int event_next(shell_context_t *ctx, pid_t *pid) {
+    struct epoll_event ev;
+    int n = epoll_wait(ctx->epoll_fd, &ev, 1, -1);
+
+    if (n <= 0) {
+        if (n == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            return EV_ERROR;
+        }
+        return 0;
+    }
+
+    switch (EV_KIND(ev.data.u64)) {
+    case EV_SIGNAL:
+        handle_signals_pending(ctx);
+        return 0;
+    case EV_JOB:
+        handle_job_exit(ctx, EV_FD(ev.data.u64), EV_PID(ev.data.u64));
+        return 0;
+    case EV_TIMER:
+        handle_timeout(ctx, EV_PID(ev.data.u64));
+        return 0;
+    case EV_CHILD:
+        /* Stop watching; the executor reaps it and closes the pidfd */
+        epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, EV_FD(ev.data.u64), NULL);
+        *pid = EV_PID(ev.data.u64);
+        return EV_CHILD;
+    default:
+        return EV_INPUT;
+    }
+}
+
+/**
+ * poll() the current pipeline's pidfds and deadline timers when there is
+ * no epoll set. target is the child to wait for, or -1 for any of them.
+ */
+static pid_t poll_children(shell_context_t *ctx, pid_t target) {
+    struct pollfd pfds[ctx->proc_count > 0 ? ctx->proc_count * 2 : 1];
+
+    for (;;) {
+        int n = 0;
+
+        for (int i = 0; i < ctx->proc_count; i++) {
+            proc_stats_t *ps = &ctx->proc_stats[i];
+            if (ps->pidfd < 0 || (target != -1 && ps->pid != target)) continue;
+
+            pfds[n++] = (struct pollfd){ps->pidfd, POLLIN, 0};
+            if (ps->timer_fd >= 0) {
+                pfds[n++] = (struct pollfd){ps->timer_fd, POLLIN, 0};
+            }
+        }
+        if (n == 0) return -1;
+
+        int ready;
+        while ((ready = poll(pfds, n, -1)) == -1 && errno == EINTR) {
+            /* Retry */
+        }
+        if (ready == -1) {
+            perror("poll");
+            return -1;
+        }
+
+        for (int i = 0; i < ctx->proc_count; i++) {
+            proc_stats_t *ps = &ctx->proc_stats[i];
+            for (int j = 0; j < n; j++) {
+                if (!pfds[j].revents) continue;
+                if (pfds[j].fd == ps->pidfd) return ps->pid;
+                if (pfds[j].fd == ps->timer_fd) handle_timeout(ctx, ps->pid);
+            }
+        }
+    }
+}
+
+/**
+ * Block until watched foreground child target (or any of them, for -1)
+ * exits and return its pid. The child is not reaped. Returns -1 if the
+ * foreground pipeline was stopped instead (ctx->fg_stopped is set), or
+ * if waiting failed: the caller then falls back to a blocking wait4().
+ */
+pid_t event_wait_child(shell_context_t *ctx, pid_t target) {
+    pid_t pid;
+
+    if (ctx->epoll_fd < 0) {
+        return poll_children(ctx, target);
+    }
+
+    for (;;) {
+        int kind = event_next(ctx, &pid);
+
+        if (kind == EV_ERROR) return -1;
+        if (kind == EV_CHILD && (target == -1 || pid == target)) break;
+
+        /* Signals and job exits are handled while we wait */
+        if (ctx->fg_stopped) return -1;
+    }
+
+    /* Ctrl-C went to the foreground job, not to us */
+    ctx->interrupted = 0;
+    return pid;
+}
+
+/**
+ * Handle one event while a job runs in the foreground. Its exits and
+ * stops update the job table.
+ */
+void event_wait_jobs(shell_context_t *ctx) {
+    pid_t pid;
+    int status;
+
+    if (event_next(ctx, &pid) != EV_ERROR) return;
+
+    /* No working event loop: block until some child exits or stops */
+    do {
+        pid = waitpid(-1, &status, WUNTRACED);
+    } while (pid == -1 && errno == EINTR);
+
+    if (pid > 0 && WIFSTOPPED(status)) {
+        job_stopped(ctx, pid, WSTOPSIG(status));
+    } else if (pid > 0) {
+        job_finished(ctx, pid, status);
+    }
+}
+
+/**
+ * For builtins that copy data inside the shell (cat, tee), which would
+ * otherwise never see Ctrl-C: SIGINT is blocked and only read from the
+ * signalfd. Called before each chunk; if fd is not -1, first waits until
+ * it is readable or a signal arrives, so a slow pipe can be interrupted
+ * too. Returns 1 (and clears the flag) if Ctrl-C was pressed. Without an
+ * event loop SIGINT is delivered normally and this always returns 0.
+ */
+int event_interrupted(shell_context_t *ctx, int fd) {
+    if (ctx->signal_fd < 0) return 0;
+
+    if (fd >= 0) {
+        struct pollfd pfds[2] = {{fd, POLLIN, 0}, {ctx->signal_fd, POLLIN, 0}};
+        while (poll(pfds, 2, -1) == -1 && errno == EINTR) {
+            /* Retry */
+        }
+    }
+
+    handle_signals_pending(ctx);
+    if (!ctx->interrupted) return 0;
+
+    ctx->interrupted = 0;
+    return 1;
+}
+
+/**
+ * Hand back the first complete line in the input buffer
+ */
+static ssize_t take_line(char **line, size_t *len, size_t end, size_t skip) {
+    if (*len < end + 1) {
+        char *buf = realloc(*line, end + 1);
+        if (!buf) {
+            perror("realloc");
+            return -1;
+        }
+        *line = buf;
+        *len = end + 1;
+    }
+
+    memcpy(*line, input_buf, end);
+    (*line)[end] = '\0';
+    input_len -= end + skip;
+    memmove(input_buf, input_buf + end + skip, input_len);
+
+    return (ssize_t)end;
+}
+
+/**
+ * Read one line from the terminal through the event loop, printing the
+ * prompt first. Ctrl-C discards the line and prompts again. Returns the
+ * line length without its newline, or -1 at end of input.
+ */
+ssize_t event_read_line(shell_context_t *ctx, char **line, size_t *len) {
+    struct epoll_event ev = {EPOLLIN, {.u64 = EV_PACK(EV_INPUT, STDIN_FILENO, 0)}};
+    ssize_t result = -1;
+
+    print_prompt();
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &ev);
+
+    for (;;) {
+        char *nl = memchr(input_buf, '\n', input_len);
+        if (nl) {
+            result = take_line(line, len, nl - input_buf, 1);
+            break;
+        }
+
+        pid_t pid;
+        int kind = event_next(ctx, &pid);
+
+        if (ctx->interrupted) {
+            ctx->interrupted = 0;
+            input_len = 0;
+            printf("\n");
+            print_prompt();
+            continue;
+        }
+        /* On EV_ERROR the read below blocks instead */
+        if (kind != EV_INPUT && kind != EV_ERROR) continue;
+
+        if (input_capacity - input_len < INPUT_CHUNK) {
+            char *buf = realloc(input_buf, input_capacity + INPUT_CHUNK);
+            if (!buf) {
+                perror("realloc");
+                break;
+            }
+            input_buf = buf;
+            input_capacity += INPUT_CHUNK;
+        }
+
+        ssize_t n = read(STDIN_FILENO, input_buf + input_len, input_capacity - input_len);
+        if (n > 0) {
+            input_len += n;
+        } else if (n == 0) {
+            /* End of input: return a final unterminated line first */
+            if (input_len > 0) {
+                result = take_line(line, len, input_len, 0);
+            }
+            break;
+        } else if (errno != EINTR && errno != EAGAIN) {
+            perror("read");
+            break;
+        }
+    }
+
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+    return result;
+}
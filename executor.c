@@ -1,5 +1,101 @@
 #include "shell.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/**
+ * Microseconds in a timeval
+ */
+static long long timeval_us(const struct timeval *tv) {
+    return (long long)tv->tv_sec * 1000000LL + tv->tv_usec;
+}
+
+/**
+ * Nanoseconds elapsed since a CLOCK_MONOTONIC timestamp
+ */
+static long long elapsed_ns(const struct timespec *start) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)(now.tv_sec - start->tv_sec) * 1000000000LL +
+           (now.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Print a duration in the m/s format used by 'time'
+ */
+static void print_time_line(const char *label, long long us) {
+    fprintf(stderr, "%s\t%lldm%lld.%03llds\n", label,
+            us / 60000000LL, (us / 1000000LL) % 60, (us / 1000LL) % 1000);
+}
+
+/**
+ * Report the resources used by a timed pipeline: totals for the shell and
+ * all its children, then one line per child process
+ */
+static void report_times(shell_context_t *ctx, long long wall_ns,
+                         const struct rusage *self0, const struct rusage *kids0) {
+    struct rusage self1, kids1;
+    
+    /* Keep builtin output and trace lines ahead of the report */
+    fflush(stdout);
+    xtrace_flush();
+    
+    getrusage(RUSAGE_SELF, &self1);
+    getrusage(RUSAGE_CHILDREN, &kids1);
+    
+    long long user = timeval_us(&self1.ru_utime) - timeval_us(&self0->ru_utime) +
+                     timeval_us(&kids1.ru_utime) - timeval_us(&kids0->ru_utime);
+    long long sys = timeval_us(&self1.ru_stime) - timeval_us(&self0->ru_stime) +
+                    timeval_us(&kids1.ru_stime) - timeval_us(&kids0->ru_stime);
+    
+    fprintf(stderr, "\n");
+    print_time_line("real", wall_ns / 1000);
+    print_time_line("user", user);
+    print_time_line("sys", sys);
+    
+    for (int i = 0; i < ctx->proc_count; i++) {
+        proc_stats_t *ps = &ctx->proc_stats[i];
+        fprintf(stderr, "  [%d] %s: real %.3fs user %.3fs sys %.3fs "
+                "maxrss %ldk csw %ld/%ld\n",
+                i + 1, ps->command, ps->wall_ns / 1e9, ps->utime_us / 1e6,
+                ps->stime_us / 1e6, ps->maxrss_kb, ps->nvcsw, ps->nivcsw);
+    }
+}
+
+/**
+ * Shell exit status for a raw wait status: the exit code, or 128 plus the
+ * signal number if the process was killed or stopped
+ */
+int exit_code(int status) {
+    if (WIFSTOPPED(status)) return 128 + WSTOPSIG(status);
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/**
+ * Shell CPU time (user + system) in microseconds since a getrusage sample
+ */
+static long long self_cpu_us(const struct rusage *self0) {
+    struct rusage self1;
+    
+    getrusage(RUSAGE_SELF, &self1);
+    return timeval_us(&self1.ru_utime) - timeval_us(&self0->ru_utime) +
+           timeval_us(&self1.ru_stime) - timeval_us(&self0->ru_stime);
+}
+
+/**
+ * CPU time in microseconds of the children of the last pipeline
+ */
+static long long children_cpu_us(shell_context_t *ctx) {
+    long long total = 0;
+    
+    for (int i = 0; i < ctx->proc_count; i++) {
+        total += ctx->proc_stats[i].utime_us + ctx->proc_stats[i].stime_us;
+    }
+    
+    return total;
+}
+
 /**
  * Execute a chain of commands
  */
@@ -8,33 +104,87 @@ int execute_command_chain(command_chain_t *chain, shell_context_t *ctx) {
         return 0;
     }
     
+    if (ctx->optimize) {
+        optimize_chain(chain, ctx, NULL);
+    }
+    
     cmd_node_t *current = chain->head;
     int last_status = 0;
     
     while (current) {
-        cmd_node_t *next = current->next;
+        /* Find the end of this pipeline */
+        cmd_node_t *last = current;
+        int stages = 1;
+        while (last->type == CMD_PIPE && last->next) {
+            last = last->next;
+            stages++;
+        }
+        cmd_node_t *next = last->next;
+        
+        struct timespec start;
+        struct rusage self0, kids0;
+        int measured = current->timed || PROFILE_ON();
+        if (measured) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            getrusage(RUSAGE_SELF, &self0);
+            getrusage(RUSAGE_CHILDREN, &kids0);
+        }
+        ctx->proc_count = 0;
+        
+        if (ctx->xtrace) {
+            cmd_node_t *stage = current;
+            for (int i = 0; i < stages; i++, stage = stage->next) {
+                xtrace_command(stage, ctx);
+            }
+        }
         
-        /* Handle piped commands */
-        if (current->type == CMD_PIPE && next) {
-            last_status = execute_piped_commands(current, next, ctx);
-            current = next->next; /* Skip the second command in pipe */
+        if (stages > 1) {
+            /* Handle piped commands */
+            last_status = execute_piped_commands(current, stages, ctx);
+        } else if (!next && ctx->exec_tail && !current->background &&
+                   !measured && current->command &&
+                   cmd_builtin_id(current) == BUILTIN_NONE &&
+                   !command_timeout(ctx, NULL)) {
+            /* Tail position: nothing runs after this, so replace the shell */
+            last_status = exec_command_in_place(current, ctx);
         } else {
             last_status = execute_single_command(current, ctx);
-            
-            /* Handle conditional execution */
-            if (next) {
-                if (current->type == CMD_AND && last_status != 0) {
-                    break; /* Stop on failure with && */
-                }
-                if (current->type == CMD_OR && last_status == 0) {
-                    break; /* Stop on success with || */
-                }
+        }
+        
+        /* The shell owns the terminal again between pipelines */
+        if (ctx->fg_pgid) {
+            job_reclaim_terminal(ctx);
+        }
+        
+        /* A foreground job killed by Ctrl-C leaves the cursor after ^C */
+        if (ctx->interactive && last_status == 128 + SIGINT) {
+            printf("\n");
+        }
+        
+        if (measured) {
+            long long wall_ns = elapsed_ns(&start);
+            if (current->timed) {
+                report_times(ctx, wall_ns, &self0, &kids0);
+            }
+            if (PROFILE_ON()) {
+                profile_pipeline(current, stages, wall_ns, self_cpu_us(&self0),
+                                 children_cpu_us(ctx));
             }
-            
-            current = next;
         }
         
         ctx->last_exit_status = last_status;
+        
+        /* && after a failure or || after a success skips a pipeline */
+        while (next && ((last->type == CMD_AND && last_status != 0) ||
+                        (last->type == CMD_OR && last_status == 0))) {
+            last = next;
+            while (last->type == CMD_PIPE && last->next) {
+                last = last->next;
+            }
+            next = last->next;
+        }
+        
+        current = next;
     }
     
     return last_status;
@@ -49,190 +199,925 @@ int execute_single_command(cmd_node_t *cmd, shell_context_t *ctx) {
     }
     
     /* Check if it's a built-in command */
-    if (is_builtin_command(cmd->command)) {
+    if (cmd_builtin_id(cmd) != BUILTIN_NONE) {
         return execute_builtin_command(cmd, ctx);
     } else {
         return execute_external_command(cmd, ctx);
     }
 }
 
+/**
+ * Open a command's stdin redirection: its input file, or a memfd holding
+ * its here-string and a newline. Returns -1 (after reporting why) if it
+ * can't be opened.
+ */
+static int open_input(cmd_node_t *cmd) {
+    if (!cmd->input_string) {
+        int fd = open(cmd->input_file, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            perror(cmd->input_file);
+        }
+        return fd;
+    }
+    
+    size_t len = strlen(cmd->input_string);
+    int fd = memfd_create("here-string", MFD_CLOEXEC);
+    if (fd == -1 ||
+        write(fd, cmd->input_string, len) != (ssize_t)len ||
+        write(fd, "\n", 1) != 1 ||
+        lseek(fd, 0, SEEK_SET) == -1) {
+        perror("here-string");
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Point fd target at fd (closing it), first saving a close-on-exec copy
+ * of the old descriptor in *saved
+ */
+static void redirect_fd(int fd, int target, int *saved) {
+    *saved = fcntl(target, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+    dup2(fd, target);
+    close(fd);
+}
+
+/**
+ * Apply a builtin's redirections in the shell itself. saved[0] and
+ * saved[1] receive the shell's stdin and stdout (-1 if untouched) for
+ * restore_builtin_fds(). Returns -1 if a file can't be opened.
+ */
+static int redirect_builtin(cmd_node_t *cmd, int saved[2]) {
+    if (cmd->input_file || cmd->input_string) {
+        int fd = open_input(cmd);
+        if (fd == -1) return -1;
+        redirect_fd(fd, STDIN_FILENO, &saved[0]);
+    }
+    
+    if (cmd->output_file) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC |
+                    (cmd->append_output ? O_APPEND : O_TRUNC);
+        int fd = open(cmd->output_file, flags, 0666);
+        if (fd == -1) {
+            perror(cmd->output_file);
+            return -1;
+        }
+        /* Earlier output belongs to the old stdout */
+        fflush(stdout);
+        redirect_fd(fd, STDOUT_FILENO, &saved[1]);
+    }
+    
+    return 0;
+}
+
+/**
+ * Put back the descriptors saved by redirect_builtin()
+ */
+static void restore_builtin_fds(int saved[2]) {
+    if (saved[1] >= 0) {
+        fflush(stdout);
+    }
+    
+    for (int fd = STDIN_FILENO; fd <= STDOUT_FILENO; fd++) {
+        if (saved[fd] >= 0) {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+        }
+    }
+}
+
 /**
  * Execute built-in commands
  */
 int execute_builtin_command(cmd_node_t *cmd, shell_context_t *ctx) {
-    if (strcmp(cmd->command, "cd") == 0) {
-        return builtin_cd(cmd->args, ctx);
-    } else if (strcmp(cmd->command, "pwd") == 0) {
-        return builtin_pwd(cmd->args, ctx);
-    } else if (strcmp(cmd->command, "echo") == 0) {
-        return builtin_echo(cmd->args, ctx);
-    } else if (strcmp(cmd->command, "env") == 0) {
-        return builtin_env(cmd->args, ctx);
-    } else if (strcmp(cmd->command, "exit") == 0) {
-        return builtin_exit(cmd->args, ctx);
+    const builtin_t *builtin = get_builtin(cmd_builtin_id(cmd));
+    int saved[2] = {-1, -1};
+    
+    if (!builtin) {
+        return 1; /* Unknown built-in */
     }
     
-    return 1; /* Unknown built-in */
+    /* Builtins write stderr directly: their trace line must come first */
+    xtrace_flush();
+    
+    long long start = trace_now();
+    int status = 1;
+    if (redirect_builtin(cmd, saved) == 0) {
+        status = builtin->fn(cmd->args, ctx);
+    }
+    restore_builtin_fds(saved);
+    long long end = trace_now();
+    
+    stats_record(&ctx->cmd_stats, cmd->command, -1, end - start);
+    metrics_command((status & 0xff) << 8, -1);
+    if (TRACE_ON()) {
+        trace_record("builtin", cmd->command, start, end - start, 0);
+    }
+    
+    return status;
 }
 
 /**
- * Execute external commands
+ * Apply redirections and replace the current process image with the command.
+ * Only returns on failure, with the exit status to report.
  */
-int execute_external_command(cmd_node_t *cmd, shell_context_t *ctx) {
-    pid_t pid = fork();
+static int exec_command_image(cmd_node_t *cmd, shell_context_t *ctx) {
+    /* Handle input redirection */
+    if (cmd->input_file || cmd->input_string) {
+        int input = open_input(cmd);
+        if (input == -1) {
+            return 1;
+        }
+        dup2(input, STDIN_FILENO);
+        close(input);
+    }
     
-    if (pid == 0) {
-        /* Child process */
-        
-        /* Handle input redirection */
-        if (cmd->input_file) {
-            FILE *input = fopen(cmd->input_file, "r");
-            if (!input) {
-                perror(cmd->input_file);
-                exit(1);
-            }
-            dup2(fileno(input), STDIN_FILENO);
-            fclose(input);
+    /* Handle output redirection */
+    if (cmd->output_file) {
+        FILE *output = fopen(cmd->output_file, 
+                           cmd->append_output ? "a" : "w");
+        if (!output) {
+            perror(cmd->output_file);
+            return 1;
         }
-        
-        /* Handle output redirection */
-        if (cmd->output_file) {
-            FILE *output = fopen(cmd->output_file, 
-                               cmd->append_output ? "a" : "w");
-            if (!output) {
-                perror(cmd->output_file);
-                exit(1);
-            }
-            dup2(fileno(output), STDOUT_FILENO);
-            fclose(output);
+        dup2(fileno(output), STDOUT_FILENO);
+        fclose(output);
+    }
+    
+    const char *path = resolve_command(cmd, ctx);
+    if (!path) {
+        fprintf(stderr, "%s: command not found\n", cmd->command);
+        return 127;
+    }
+    
+    /* Prepare arguments for execve */
+    char **exec_args = malloc((cmd->argc + 2) * sizeof(char*));
+    if (!exec_args) {
+        perror("malloc");
+        return 1;
+    }
+    
+    exec_args[0] = cmd->command;
+    for (int i = 0; i < cmd->argc; i++) {
+        exec_args[i + 1] = cmd->args[i];
+    }
+    exec_args[cmd->argc + 1] = NULL;
+    
+    /* Execute the command with the shell's exported variables */
+    execve(path, exec_args, var_envp(ctx->vars));
+    
+    /* If execve returns, there was an error */
+    int err = errno;
+    fprintf(stderr, "%s: %s\n", cmd->command, strerror(err));
+    free(exec_args);
+    return err == ENOENT ? 127 : 126;
+}
+
+/**
+ * Execute the final command of a non-interactive run without forking.
+ * The shell process becomes the command, so its exit status is the
+ * command's. Only returns if the exec fails.
+ */
+int exec_command_in_place(cmd_node_t *cmd, shell_context_t *ctx) {
+    /* Reap the helper now; the exec'd program would never wait for it */
+    forkserver_stop(ctx);
+    
+    /* Pending builtin output would be lost across exec */
+    fflush(stdout);
+    fflush(stderr);
+    xtrace_flush();
+    
+    /* atexit() won't run after exec, so write the trace now */
+    if (TRACE_ON()) {
+        resolve_command(cmd, ctx);
+        trace_record("exec", cmd->command, trace_now(), -1, 0);
+        trace_flush();
+    }
+    
+    /* Undo shell-only dispositions; ignored signals and the mask survive exec */
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    event_loop_child();
+    
+    return exec_command_image(cmd, ctx);
+}
+
+/**
+ * Start tracking a child process in the current pipeline's stats.
+ * start_ns is the trace_now() time just before the fork. Returns NULL
+ * (and the child simply isn't reported) if out of memory.
+ */
+proc_stats_t* record_child(shell_context_t *ctx, cmd_node_t *cmd, pid_t pid,
+                           long long start_ns) {
+    if (ctx->proc_count == ctx->proc_capacity) {
+        int capacity = ctx->proc_capacity ? ctx->proc_capacity * 2 : 8;
+        proc_stats_t *stats = realloc(ctx->proc_stats, capacity * sizeof(proc_stats_t));
+        if (!stats) {
+            perror("realloc");
+            return NULL;
         }
-        
-        /* Prepare arguments for execvp */
-        char **exec_args = malloc((cmd->argc + 2) * sizeof(char*));
-        if (!exec_args) {
-            perror("malloc");
-            exit(1);
+        ctx->proc_stats = stats;
+        ctx->proc_capacity = capacity;
+    }
+    
+    proc_stats_t *ps = &ctx->proc_stats[ctx->proc_count++];
+    memset(ps, 0, sizeof(*ps));
+    ps->command = cmd->command;
+    ps->pid = pid;
+    ps->launch_ns = -1;
+    ps->pidfd = -1;
+    ps->running = 1;
+    ps->timer_fd = -1;
+    ps->start.tv_sec = start_ns / 1000000000LL;
+    ps->start.tv_nsec = start_ns % 1000000000LL;
+    
+    return ps;
+}
+
+/**
+ * The fork server helper was reaped: fall back to local forks from now on
+ */
+static void forkserver_lost(shell_context_t *ctx) {
+    close(ctx->forkserver_fd);
+    ctx->forkserver_fd = -1;
+    ctx->forkserver_pid = -1;
+}
+
+/**
+ * Reap finished background jobs without blocking
+ */
+void reap_background_jobs(shell_context_t *ctx) {
+    int status;
+    pid_t pid;
+    
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (pid == ctx->forkserver_pid) {
+            forkserver_lost(ctx);
+        } else {
+            job_finished(ctx, pid, status);
+        }
+    }
+}
+
+/**
+ * Fill in a tracked child's stats once it has been reaped and add its
+ * latencies to the per-command histograms
+ */
+void finish_child(shell_context_t *ctx, proc_stats_t *ps, int status,
+                  const struct rusage *ru) {
+    ps->status = status;
+    ps->running = 0;
+    if (ps->timer_fd >= 0) {
+        close(ps->timer_fd);
+        ps->timer_fd = -1;
+    }
+    ps->wall_ns = elapsed_ns(&ps->start);
+    ps->utime_us = timeval_us(&ru->ru_utime);
+    ps->stime_us = timeval_us(&ru->ru_stime);
+    ps->maxrss_kb = ru->ru_maxrss;
+    ps->nvcsw = ru->ru_nvcsw;
+    ps->nivcsw = ru->ru_nivcsw;
+    
+    stats_record(&ctx->cmd_stats, ps->command, ps->launch_ns, ps->wall_ns);
+    metrics_command(status, ps->launch_ns);
+    
+    /* Child lifetime on its own track in the trace */
+    if (TRACE_ON()) {
+        trace_record("process", ps->command,
+                     (long long)ps->start.tv_sec * 1000000000LL + ps->start.tv_nsec,
+                     ps->wall_ns, ps->pid);
+    }
+}
+
+/**
+ * Hand a new foreground child's pidfd to the event loop. Returns the
+ * pidfd for the child's record, or -1 (closing it) if the child can't be
+ * watched.
+ */
+static int keep_pidfd(shell_context_t *ctx, pid_t pid, int pidfd) {
+    if (pidfd < 0) return -1;
+    
+    if (event_watch_child(ctx, pid, pidfd, 0) == -1) {
+        close(pidfd);
+        return -1;
+    }
+    return pidfd;
+}
+
+/**
+ * Start a foreground child's deadline, if it has one and can be watched
+ */
+static void arm_deadline(shell_context_t *ctx, proc_stats_t *ps,
+                         long long timeout_ns, long long grace_ns) {
+    if (timeout_ns > 0 && ps->pidfd >= 0) {
+        event_arm_timeout(ctx, ps, timeout_ns, grace_ns);
+    }
+}
+
+/**
+ * Find a tracked child of the current pipeline by pid
+ */
+static proc_stats_t* find_child(shell_context_t *ctx, pid_t pid) {
+    for (int i = 0; i < ctx->proc_count; i++) {
+        if (ctx->proc_stats[i].pid == pid) {
+            return &ctx->proc_stats[i];
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Reap one specific child with wait4(), recording its resource usage if
+ * it is tracked. Returns the raw wait status, which is a stop status if
+ * the child was stopped instead (ctx->fg_stopped is set).
+ */
+static int wait_child(shell_context_t *ctx, pid_t pid) {
+    struct rusage ru;
+    int status = 0;
+    long long start = TRACE_ON() ? trace_now() : 0;
+    proc_stats_t *ps = find_child(ctx, pid);
+    
+    /* Sleep until the pidfd says it has exited */
+    if (ps && ps->pidfd >= 0) {
+        if (event_wait_child(ctx, pid) == -1 && ctx->fg_stopped) {
+            return W_STOPCODE(ctx->fg_stopped);
         }
+        close(ps->pidfd);
+        ps->pidfd = -1;
+    }
+    
+    while (wait4(pid, &status, ctx->job_control ? WUNTRACED : 0, &ru) == -1) {
+        if (errno != EINTR) {
+            perror("wait4");
+            return 1 << 8;
+        }
+    }
+    
+    if (WIFSTOPPED(status)) {
+        ctx->fg_stopped = WSTOPSIG(status);
+        return status;
+    }
+    
+    if (TRACE_ON()) {
+        trace_record("wait", NULL, start, trace_now() - start, 0);
+    }
+    
+    if (ps) {
+        finish_child(ctx, ps, status, &ru);
+    }
+    
+    return status;
+}
+
+/**
+ * Resolve a command name to an executable path by searching the given
+ * PATH value.
+ * Names containing a slash are used as-is. Returns a newly allocated
+ * string, or NULL if the command was not found.
+ */
+char* find_command_path(const char *name, const char *path) {
+    if (strchr(name, '/')) {
+        return shell_strdup(name);
+    }
+    
+    if (!path) {
+        path = "/usr/local/bin:/usr/bin:/bin";
+    }
+    
+    size_t name_len = strlen(name);
+    char candidate[MAX_COMMAND_LENGTH];
+    
+    while (*path) {
+        const char *colon = strchr(path, ':');
+        size_t dir_len = colon ? (size_t)(colon - path) : strlen(path);
         
-        exec_args[0] = cmd->command;
-        for (int i = 0; i < cmd->argc; i++) {
-            exec_args[i + 1] = cmd->args[i];
+        if (dir_len + name_len + 2 <= sizeof(candidate)) {
+            /* Empty PATH entry means the current directory */
+            if (dir_len == 0) {
+                memcpy(candidate, name, name_len + 1);
+            } else {
+                memcpy(candidate, path, dir_len);
+                candidate[dir_len] = '/';
+                memcpy(candidate + dir_len + 1, name, name_len + 1);
+            }
+            
+            if (access(candidate, X_OK) == 0) {
+                return shell_strdup(candidate);
+            }
         }
-        exec_args[cmd->argc + 1] = NULL;
         
-        /* Execute the command */
-        execvp(cmd->command, exec_args);
+        if (!colon) break;
+        path = colon + 1;
+    }
+    
+    return NULL;
+}
+
+/**
+ * Resolve a command's executable path once and cache it in the node
+ */
+const char* resolve_command(cmd_node_t *cmd, shell_context_t *ctx) {
+    if (!cmd->path) {
+        long long start = TRACE_ON() ? trace_now() : 0;
         
-        /* If execvp returns, there was an error */
+        cmd->path = find_command_path(cmd->command, var_get(ctx->vars, "PATH"));
+        if (TRACE_ON()) {
+            trace_record("resolve", cmd->command, start, trace_now() - start, 0);
+        }
+    }
+    
+    return cmd->path;
+}
+
+/**
+ * Run a foreground command through the fork server. Redirections are
+ * opened here and passed to the helper as descriptors. Returns 0 with
+ * *status set, or -1 if the caller should fork locally instead.
+ */
+static int launch_via_forkserver(cmd_node_t *cmd, shell_context_t *ctx, int *status) {
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    int result = -1;
+    
+    const char *path = resolve_command(cmd, ctx);
+    if (!path) {
+        fprintf(stderr, "%s: command not found\n", cmd->command);
+        metrics_command(127 << 8, -1);
+        *status = 127 << 8;
+        return 0;
+    }
+    
+    char **exec_args = malloc((cmd->argc + 2) * sizeof(char*));
+    if (!exec_args) {
+        perror("malloc");
+        return -1;
+    }
+    
+    exec_args[0] = cmd->command;
+    for (int i = 0; i < cmd->argc; i++) {
+        exec_args[i + 1] = cmd->args[i];
+    }
+    exec_args[cmd->argc + 1] = NULL;
+    
+    if (cmd->input_file || cmd->input_string) {
+        fds[0] = open_input(cmd);
+        if (fds[0] == -1) {
+            *status = 1 << 8;
+            result = 0;
+            goto out;
+        }
+    }
+    
+    if (cmd->output_file) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC |
+                    (cmd->append_output ? O_APPEND : O_TRUNC);
+        fds[1] = open(cmd->output_file, flags, 0666);
+        if (fds[1] == -1) {
+            perror(cmd->output_file);
+            *status = 1 << 8;
+            result = 0;
+            goto out;
+        }
+    }
+    
+    result = forkserver_run(ctx, cmd, path, exec_args, var_envp(ctx->vars), fds, status);
+    
+out:
+    if (fds[0] > STDERR_FILENO) close(fds[0]);
+    if (fds[1] > STDERR_FILENO) close(fds[1]);
+    free(exec_args);
+    return result;
+}
+
+/**
+ * Exec a command in a forked child. If the exec fails, one byte is
+ * written to the launch handshake pipe before exiting. Never returns.
+ */
+static void __attribute__((noreturn))
+exec_child(cmd_node_t *cmd, shell_context_t *ctx, int handshake_fd) {
+    signal(SIGQUIT, SIG_DFL);
+    event_loop_child();
+    
+    int status = exec_command_image(cmd, ctx);
+    if (handshake_fd >= 0) {
+        unsigned char byte = (unsigned char)status;
+        ssize_t n = write(handshake_fd, &byte, 1);
+        (void)n;
+    }
+    
+    _exit(status);
+}
+
+/**
+ * Wait for a child's launch handshake. The write end is close-on-exec,
+ * so EOF means the exec succeeded and a byte means it failed. Returns the
+ * nanoseconds from fork_start to a successful exec, or -1.
+ */
+static long long await_exec(int handshake_fd, long long fork_start) {
+    unsigned char byte;
+    ssize_t n;
+    
+    do {
+        n = read(handshake_fd, &byte, 1);
+    } while (n == -1 && errno == EINTR);
+    
+    close(handshake_fd);
+    return n == 0 ? trace_now() - fork_start : -1;
+}
+
+/**
+ * Run the external program called name with args, even when a builtin
+ * has the same name. For builtins that leave some cases to the real tool.
+ */
+int execute_external_args(const char *name, char **args, shell_context_t *ctx) {
+    cmd_node_t external;
+    
+    memset(&external, 0, sizeof(external));
+    external.command = (char *)name;
+    external.args = args;
+    while (args && args[external.argc]) {
+        external.argc++;
+    }
+    external.type = CMD_SIMPLE;
+    external.builtin_id = BUILTIN_NONE;
+    
+    int status = execute_external_command(&external, ctx);
+    shell_free(external.path);
+    return status;
+}
+
+/**
+ * Execute external commands
+ */
+int execute_external_command(cmd_node_t *cmd, shell_context_t *ctx) {
+    /* Don't let the child inherit (and later re-flush) buffered output */
+    fflush(stdout);
+    xtrace_flush();
+    
+    /* Resolve before forking so a missing command costs no process */
+    if (!resolve_command(cmd, ctx)) {
         fprintf(stderr, "%s: command not found\n", cmd->command);
-        free(exec_args);
-        exit(127);
+        metrics_command(127 << 8, -1);
+        return 127;
+    }
+    
+    long long grace_ns = 0;
+    long long timeout_ns = cmd->background ? 0 : command_timeout(ctx, &grace_ns);
+    
+    /* The helper can't put its children in our process groups or kill them */
+    if (ctx->forkserver_fd >= 0 && !cmd->background && !ctx->job_control &&
+        !timeout_ns) {
+        int status;
+        if (launch_via_forkserver(cmd, ctx, &status) == 0) {
+            return exit_code(status);
+        }
+    }
+    
+    /* Close-on-exec pipe that tells us when the exec has happened */
+    int handshake[2];
+    if (pipe2(handshake, O_CLOEXEC) == -1) {
+        handshake[0] = handshake[1] = -1;
+    }
+    
+    long long fork_start = trace_now();
+    int pidfd;
+    pid_t pid = fork_pidfd(&pidfd);
+    
+    if (pid == 0) {
+        /* Child process */
+        if (handshake[0] >= 0) {
+            close(handshake[0]);
+        }
+        job_launch_child(ctx, 0, !cmd->background);
+        exec_child(cmd, ctx, handshake[1]);
         
     } else if (pid > 0) {
         /* Parent process */
+        job_launch_parent(ctx, pid, 0, !cmd->background);
+        if (TRACE_ON()) {
+            trace_record("fork", cmd->command, fork_start, trace_now() - fork_start, 0);
+        }
+        
+        long long launch_ns = -1;
+        if (handshake[0] >= 0) {
+            close(handshake[1]);
+            launch_ns = await_exec(handshake[0], fork_start);
+        }
+        
         if (!cmd->background) {
-            int status;
-            waitpid(pid, &status, 0);
-            return WEXITSTATUS(status);
+            proc_stats_t *ps = record_child(ctx, cmd, pid, fork_start);
+            if (ps) {
+                ps->launch_ns = launch_ns;
+                ps->pidfd = keep_pidfd(ctx, pid, pidfd);
+                arm_deadline(ctx, ps, timeout_ns, grace_ns);
+            } else if (pidfd >= 0) {
+                close(pidfd);
+            }
+            
+            int status = wait_child(ctx, pid);
+            if (WIFSTOPPED(status)) {
+                return job_stop_foreground(ctx, cmd, 1);
+            }
+            return ps && ps->timed_out ? EXIT_TIMEOUT : exit_code(status);
         } else {
-            printf("[%d] %s\n", pid, cmd->command);
+            job_t *job = job_create(ctx, cmd, 1, ctx->job_control ? pid : 0);
+            if (job && job_add_process(ctx, job, pid, pidfd) == 0) {
+                job_started(ctx, job);
+            }
             return 0;
         }
     } else {
         perror("fork");
+        metrics_fork_failure();
+        if (handshake[0] >= 0) {
+            close(handshake[0]);
+            close(handshake[1]);
+        }
         return 1;
     }
 }
 
 /**
- * Execute piped commands
+ * Forget the shell's children in a forked stage: their pidfds and
+ * deadline timers belong to the shell, and the stage waits only for
+ * children of its own
+ */
+static void forget_children(shell_context_t *ctx) {
+    for (int i = 0; i < ctx->proc_count; i++) {
+        proc_stats_t *ps = &ctx->proc_stats[i];
+        if (ps->pidfd >= 0) {
+            close(ps->pidfd);
+        }
+        if (ps->timer_fd >= 0) {
+            close(ps->timer_fd);
+        }
+    }
+    ctx->proc_count = 0;
+}
+
+/**
+ * Run one pipeline stage in a forked child. Never returns.
  */
-int execute_piped_commands(cmd_node_t *cmd1, cmd_node_t *cmd2, shell_context_t *ctx) {
-    int pipe_fd[2];
-    pid_t pid1, pid2;
-    int status1, status2;
+static void run_pipeline_stage(cmd_node_t *cmd, shell_context_t *ctx, int handshake_fd) {
+    /* Builtins run in the child, like a subshell */
+    if (cmd_builtin_id(cmd) != BUILTIN_NONE) {
+        signal(SIGQUIT, SIG_DFL);
+        /* The epoll set is shared with the shell; children we start are polled */
+        event_loop_free(ctx);
+        forget_children(ctx);
+        ctx->job_control = 0;
+        int status = execute_builtin_command(cmd, ctx);
+        fflush(stdout);
+        /* exit() would seek the shell's script stream back to what it has read */
+        _exit(status);
+    }
     
-    (void)ctx; /* Suppress unused parameter warning */
+    exec_child(cmd, ctx, handshake_fd);
+}
+
+/* A stage's launch handshake, read once every stage has been forked */
+typedef struct {
+    int fd;                        /* Read end of the handshake pipe */
+    pid_t pid;
+    long long fork_start;
+} stage_handshake_t;
+
+/**
+ * Execute a pipeline of stages connected by CMD_PIPE nodes
+ */
+int execute_piped_commands(cmd_node_t *first, int stages, shell_context_t *ctx) {
+    cmd_node_t *cmd = first;
+    stage_handshake_t *handshakes = NULL;
+    int pending = 0;
+    int in_fd = -1;
+    int launched = 0;
+    int watched = 0;
+    pid_t last_pid = -1;
+    pid_t pgid = 0;
+    job_t *job = NULL;
     
-    if (pipe(pipe_fd) == -1) {
-        perror("pipe");
-        return 1;
+    /* '&' after the last stage puts the whole pipeline in the background */
+    cmd_node_t *last = first;
+    for (int i = 1; i < stages; i++) {
+        last = last->next;
+    }
+    int background = last->background;
+    int timed_out = 0;
+    long long grace_ns = 0;
+    long long timeout_ns = background ? 0 : command_timeout(ctx, &grace_ns);
+    
+    fflush(stdout);
+    xtrace_flush();
+    
+    /* Launch times only go into the foreground stages' stats */
+    if (!background) {
+        handshakes = malloc(stages * sizeof(stage_handshake_t));
     }
     
-    /* First command (left side of pipe) */
-    pid1 = fork();
-    if (pid1 == 0) {
-        close(pipe_fd[0]); /* Close read end */
-        dup2(pipe_fd[1], STDOUT_FILENO); /* Redirect stdout to pipe */
-        close(pipe_fd[1]);
+    for (int i = 0; i < stages; i++, cmd = cmd->next) {
+        int pipe_fd[2] = {-1, -1};
+        
+        if (i < stages - 1 && pipe(pipe_fd) == -1) {
+            perror("pipe");
+            break;
+        }
+        int pipe_size = pipe_fd[1] != -1 ? pipe_tune(ctx, pipe_fd[1], cmd) : 0;
+        
+        int handshake[2] = {-1, -1};
+        if (cmd_builtin_id(cmd) == BUILTIN_NONE) {
+            resolve_command(cmd, ctx);
+            if (!handshakes || pipe2(handshake, O_CLOEXEC) == -1) {
+                handshake[0] = handshake[1] = -1;
+            }
+        }
+        
+        long long fork_start = trace_now();
+        int pidfd;
+        pid_t pid = fork_pidfd(&pidfd);
+        if (pid == 0) {
+            /* Stage reads the previous pipe and writes the next one */
+            if (in_fd != -1) {
+                dup2(in_fd, STDIN_FILENO);
+                close(in_fd);
+            }
+            if (pipe_fd[1] != -1) {
+                dup2(pipe_fd[1], STDOUT_FILENO);
+                close(pipe_fd[0]);
+                close(pipe_fd[1]);
+            }
+            if (handshake[0] >= 0) {
+                close(handshake[0]);
+            }
+            job_launch_child(ctx, pgid, !background);
+            run_pipeline_stage(cmd, ctx, handshake[1]);
+        }
+        
+        if (pid > 0) {
+            job_launch_parent(ctx, pid, pgid, !background);
+            if (!pgid && ctx->job_control) {
+                pgid = pid;
+            }
+        }
+        
+        /* Don't wait for the exec here: the next stage can fork meanwhile */
+        if (handshake[0] >= 0) {
+            close(handshake[1]);
+            if (pid > 0) {
+                handshakes[pending].fd = handshake[0];
+                handshakes[pending].pid = pid;
+                handshakes[pending].fork_start = fork_start;
+                pending++;
+            } else {
+                close(handshake[0]);
+            }
+        }
         
-        /* Prepare and execute first command */
-        char **exec_args = malloc((cmd1->argc + 2) * sizeof(char*));
-        if (!exec_args) {
-            perror("malloc");
-            exit(1);
+        /* Parent keeps only the read end for the next stage */
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        if (pipe_fd[1] != -1) {
+            close(pipe_fd[1]);
         }
+        in_fd = pipe_fd[0];
+        
+        if (pid < 0) {
+            perror("fork");
+            metrics_fork_failure();
+            break;
+        }
+        
+        if (TRACE_ON()) {
+            trace_record("fork", cmd->command, fork_start, trace_now() - fork_start, 0);
+        }
+        
+        launched++;
+        last_pid = pid;
         
-        exec_args[0] = cmd1->command;
-        for (int i = 0; i < cmd1->argc; i++) {
-            exec_args[i + 1] = cmd1->args[i];
+        if (background) {
+            if (!job) {
+                job = job_create(ctx, first, stages, pgid);
+            }
+            if (job) {
+                job_add_process(ctx, job, pid, pidfd);
+            } else if (pidfd >= 0) {
+                close(pidfd);
+            }
+            continue;
         }
-        exec_args[cmd1->argc + 1] = NULL;
         
-        execvp(cmd1->command, exec_args);
-        fprintf(stderr, "%s: command not found\n", cmd1->command);
-        free(exec_args);
-        exit(127);
+        proc_stats_t *ps = record_child(ctx, cmd, pid, fork_start);
+        if (ps) {
+            ps->pipe_size = pipe_size;
+            ps->pidfd = keep_pidfd(ctx, pid, pidfd);
+            if (ps->pidfd >= 0) {
+                watched++;
+            }
+            arm_deadline(ctx, ps, timeout_ns, grace_ns);
+        } else if (pidfd >= 0) {
+            close(pidfd);
+        }
+    }
+    
+    if (in_fd != -1) {
+        close(in_fd);
+    }
+    
+    /* Every stage is running; now collect their exec handshakes */
+    for (int i = 0; i < pending; i++) {
+        long long launch_ns = await_exec(handshakes[i].fd, handshakes[i].fork_start);
+        proc_stats_t *ps = find_child(ctx, handshakes[i].pid);
+        if (ps) {
+            ps->launch_ns = launch_ns;
+        }
+    }
+    free(handshakes);
+    
+    if (background) {
+        if (job && job->nprocs > 0) {
+            job_started(ctx, job);
+        }
+        return 0;
     }
     
-    /* Second command (right side of pipe) */
-    pid2 = fork();
-    if (pid2 == 0) {
-        close(pipe_fd[1]); /* Close write end */
-        dup2(pipe_fd[0], STDIN_FILENO); /* Redirect stdin from pipe */
-        close(pipe_fd[0]);
+    /* Reap stages in whatever order they finish so wall times are exact */
+    long long wait_start = TRACE_ON() ? trace_now() : 0;
+    int last_status = 1 << 8;
+    while (launched > 0) {
+        struct rusage ru;
+        int status;
+        pid_t target = -1;
+        pid_t pid;
+        
+        /* Stages with a pidfd are waited for through it */
+        if (watched > 0) {
+            target = event_wait_child(ctx, -1);
+            if (target == -1 && ctx->fg_stopped) break;
+            /* If waiting failed, reap the rest with blocking wait4() */
+            watched = target == -1 ? 0 : watched - 1;
+        }
+        
+        do {
+            pid = wait4(target, &status, ctx->job_control ? WUNTRACED : 0, &ru);
+        } while (pid == -1 && errno == EINTR);
         
-        /* Prepare and execute second command */
-        char **exec_args = malloc((cmd2->argc + 2) * sizeof(char*));
-        if (!exec_args) {
-            perror("malloc");
-            exit(1);
+        if (pid == -1) {
+            perror("wait4");
+            break;
         }
         
-        exec_args[0] = cmd2->command;
-        for (int i = 0; i < cmd2->argc; i++) {
-            exec_args[i + 1] = cmd2->args[i];
+        if (pid == ctx->forkserver_pid) {
+            forkserver_lost(ctx);
+            continue;
         }
-        exec_args[cmd2->argc + 1] = NULL;
         
-        execvp(cmd2->command, exec_args);
-        fprintf(stderr, "%s: command not found\n", cmd2->command);
-        free(exec_args);
-        exit(127);
+        proc_stats_t *ps = find_child(ctx, pid);
+        if (WIFSTOPPED(status)) {
+            if (!ps) {
+                job_stopped(ctx, pid, WSTOPSIG(status));
+                continue;
+            }
+            ctx->fg_stopped = WSTOPSIG(status);
+            break;
+        }
+        if (!ps) {
+            job_finished(ctx, pid, status); /* An earlier background job */
+            continue;
+        }
+        if (ps->pidfd >= 0) {
+            close(ps->pidfd);
+            ps->pidfd = -1;
+        }
+        
+        timed_out |= ps->timed_out;
+        finish_child(ctx, ps, status, &ru);
+        pipe_observe(ctx, ps);
+        launched--;
+        if (pid == last_pid) {
+            last_status = status;
+        }
     }
     
-    /* Parent process - close both ends of pipe and wait */
-    close(pipe_fd[0]);
-    close(pipe_fd[1]);
+    if (TRACE_ON()) {
+        trace_record("wait", first->command, wait_start, trace_now() - wait_start, 0);
+    }
+    
+    if (ctx->fg_stopped) {
+        return job_stop_foreground(ctx, first, stages);
+    }
     
-    waitpid(pid1, &status1, 0);
-    waitpid(pid2, &status2, 0);
+    if (timed_out) {
+        return EXIT_TIMEOUT;
+    }
     
     /* Return exit status of the last command in the pipe */
-    return WEXITSTATUS(status2);
+    return last_pid == -1 ? 1 : exit_code(last_status);
 }
 
 /**
  * Check if a command is built-in
  */
 int is_builtin_command(const char *command) {
-    const char *builtins[] = {"cd", "pwd", "echo", "env", "exit", NULL};
-    
-    for (int i = 0; builtins[i]; i++) {
-        if (strcmp(command, builtins[i]) == 0) {
-            return 1;
-        }
-    }
-    
-    return 0;
-}
\ No newline at end of file
+    return lookup_builtin(command) != BUILTIN_NONE;
+}
@@ -0,0 +1,371 @@
+#include "shell.h"
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/*
+ * Fork server
+ *
+ * A helper process forked right after shell initialization, while the
+ * shell's heap is still tiny. The shell sends it a fully resolved command
+ * (path, argv, envp) and its umask, plus the child's stdin/stdout/stderr
+ * and the shell's working directory as SCM_RIGHTS descriptors over a
+ * SOCK_SEQPACKET socketpair, so the command starts in the shell's
+ * current directory rather than the one the helper was forked in. The
+ * helper forks, execs, replies with the child's pid and later its wait
+ * status and rusage.
+ * Launch latency therefore no longer depends on how large the main shell
+ * has grown.
+ */
+
+#define FS_MAX_MSG (256 * 1024)   /* Larger requests fall back to fork() */
+
+#define FS_NFDS 4                 /* stdin, stdout, stderr, working directory */
+
+/* Request header; followed by path, argv and envp as NUL-terminated strings */
+typedef struct {
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t umask;                 /* Shell's file creation mask */
+} fs_request_t;
+
+/* Reply sent once after fork and once after the child is reaped */
+typedef struct {
+    int32_t kind;                   /* FS_REPLY_PID or FS_REPLY_STATUS */
+    int32_t pid;                    /* Child pid, -1 if fork failed */
+    int32_t status;                 /* Raw wait status */
+    int32_t error;                  /* errno of a failed fork */
+    int64_t launch_ns;              /* Fork to successful exec, -1 if failed */
+    struct rusage usage;            /* Child's resource usage (status reply) */
+} fs_reply_t;
+
+enum { FS_REPLY_PID, FS_REPLY_STATUS };
+
+/**
+ * Exec a request in the helper's child. Never returns.
+ */
+static void fs_child_exec(int sock, int handshake_fd, int fds[FS_NFDS], mode_t mask,
+                          char *path, char **argv, char **envp) {
+    /* Take on the shell's directory and umask, not the helper's */
+    if (fds[3] >= 0 && fchdir(fds[3]) == -1) {
+        int err = errno;
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+        _exit(126);
+    }
+    umask(mask);
+
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] != i) {
+            dup2(fds[i], i);
+        }
+    }
+    for (int i = 0; i < FS_NFDS; i++) {
+        if (fds[i] > 2) {
+            close(fds[i]);
+        }
+    }
+    close(sock);
+
+    /* The helper ignores terminal signals; the command must not */
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+
+    execve(path, argv, envp);
+
+    int err = errno;
+    ssize_t n = write(handshake_fd, &err, sizeof(err));
+    (void)n;
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+    _exit(err == ENOENT ? 127 : 126);
+}
+
+/**
+ * Serve one request. Returns 0 when the shell has gone away.
+ */
+static int fs_serve_one(int sock) {
+    char cbuf[CMSG_SPACE(FS_NFDS * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+    fs_reply_t reply;
+    int fds[FS_NFDS] = {0, 1, 2, -1};
+
+    /* Peek at the real message size before receiving it */
+    ssize_t size = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC);
+    if (size <= 0) {
+        return size < 0 && errno == EINTR;
+    }
+
+    char *buf = malloc(size + 1);
+    if (!buf) {
+        return 0;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != size || (size_t)size < sizeof(fs_request_t)) {
+        free(buf);
+        return 0;
+    }
+    buf[size] = '\0';
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+
+    /* Unpack path, argv and envp in place */
+    fs_request_t req;
+    memcpy(&req, buf, sizeof(req));
+    char **vec = malloc((req.argc + req.envc + 2) * sizeof(char*));
+    char *p = buf + sizeof(req);
+    char *end = buf + size;
+    char *path = p;
+
+    if (!vec) {
+        free(buf);
+        return 0;
+    }
+    p += strlen(p) + 1;
+    for (uint32_t i = 0; i < req.argc + req.envc + 2; i++) {
+        if (i == req.argc || i == req.argc + req.envc + 1 || p >= end) {
+            vec[i] = NULL;
+            continue;
+        }
+        vec[i] = p;
+        p += strlen(p) + 1;
+    }
+
+    /* Close-on-exec pipe: EOF tells us the exec succeeded */
+    int handshake[2];
+    if (pipe2(handshake, O_CLOEXEC) == -1) {
+        handshake[0] = handshake[1] = -1;
+    }
+
+    long long fork_start = trace_now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(handshake[0]);
+        fs_child_exec(sock, handshake[1], fds, (mode_t)req.umask, path,
+                      vec, vec + req.argc + 1);
+    }
+
+    int64_t launch_ns = -1;
+    if (handshake[0] >= 0) {
+        int err;
+        close(handshake[1]);
+        if (pid > 0 && read(handshake[0], &err, sizeof(err)) == 0) {
+            launch_ns = trace_now() - fork_start;
+        }
+        close(handshake[0]);
+    }
+
+    for (int i = 0; i < FS_NFDS; i++) {
+        if (fds[i] > 2) {
+            close(fds[i]);
+        }
+    }
+    free(vec);
+    free(buf);
+
+    memset(&reply, 0, sizeof(reply));
+    reply.kind = FS_REPLY_PID;
+    reply.pid = pid;
+    reply.error = pid < 0 ? errno : 0;
+    if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        return 0;
+    }
+    if (pid < 0) {
+        return 1;
+    }
+
+    int status = 0;
+    while (wait4(pid, &status, 0, &reply.usage) == -1 && errno == EINTR) {
+        /* Retry */
+    }
+    reply.kind = FS_REPLY_STATUS;
+    reply.status = status;
+    reply.launch_ns = launch_ns;
+    return send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) == sizeof(reply);
+}
+
+/**
+ * Start the fork server helper process
+ */
+int forkserver_start(shell_context_t *ctx) {
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        /* Helper: serve until the shell closes its end */
+        close(sv[0]);
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        while (fs_serve_one(sv[1])) {
+            /* Keep serving */
+        }
+        _exit(0);
+    }
+
+    close(sv[1]);
+    ctx->forkserver_fd = sv[0];
+    ctx->forkserver_pid = pid;
+    return 0;
+}
+
+/**
+ * Stop the fork server helper process
+ */
+void forkserver_stop(shell_context_t *ctx) {
+    if (ctx->forkserver_fd < 0) return;
+
+    close(ctx->forkserver_fd);
+    waitpid(ctx->forkserver_pid, NULL, 0);
+    ctx->forkserver_fd = -1;
+    ctx->forkserver_pid = -1;
+}
+
+/**
+ * Receive one reply, retrying on interruption
+ */
+static int fs_recv_reply(int sock, fs_reply_t *reply) {
+    ssize_t n;
+
+    do {
+        n = recv(sock, reply, sizeof(*reply), 0);
+    } while (n == -1 && errno == EINTR);
+
+    return n == sizeof(*reply) ? 0 : -1;
+}
+
+/**
+ * Launch a resolved command through the fork server and wait for it.
+ * fds are the child's stdin, stdout and stderr. Returns 0 and fills
+ * *status with the raw wait status, or -1 if the request could not be
+ * handed off (the caller should fork locally instead).
+ */
+int forkserver_run(shell_context_t *ctx, cmd_node_t *cmd, const char *path,
+                   char **argv, char **envp, int fds[3], int *status) {
+    fs_request_t req;
+    size_t len = sizeof(req) + strlen(path) + 1;
+
+    if (ctx->forkserver_fd < 0) return -1;
+
+    long long start_ns = trace_now();
+    req.argc = 0;
+    req.envc = 0;
+    mode_t mask = umask(0);
+    umask(mask);
+    req.umask = mask;
+    for (char **a = argv; *a; a++) {
+        len += strlen(*a) + 1;
+        req.argc++;
+    }
+    for (char **e = envp; e && *e; e++) {
+        len += strlen(*e) + 1;
+        req.envc++;
+    }
+    if (len > FS_MAX_MSG) return -1;
+
+    char *buf = malloc(len);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+
+    char *p = buf;
+    memcpy(p, &req, sizeof(req));
+    p += sizeof(req);
+    p = stpcpy(p, path) + 1;
+    for (char **a = argv; *a; a++) {
+        p = stpcpy(p, *a) + 1;
+    }
+    for (char **e = envp; e && *e; e++) {
+        p = stpcpy(p, *e) + 1;
+    }
+
+    /* The child starts in this directory, whatever the helper's is */
+    int dir_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        free(buf);
+        return -1;
+    }
+    int send_fds[FS_NFDS] = {fds[0], fds[1], fds[2], dir_fd};
+
+    char cbuf[CMSG_SPACE(FS_NFDS * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(send_fds));
+    memcpy(CMSG_DATA(cmsg), send_fds, sizeof(send_fds));
+
+    ssize_t sent = sendmsg(ctx->forkserver_fd, &msg, MSG_NOSIGNAL);
+    close(dir_fd);
+    free(buf);
+    if (sent != (ssize_t)len) {
+        return -1;
+    }
+
+    fs_reply_t reply;
+    if (fs_recv_reply(ctx->forkserver_fd, &reply) == -1) {
+        forkserver_stop(ctx);
+        return -1;
+    }
+    if (reply.pid < 0) {
+        errno = reply.error;
+        perror("fork");
+        metrics_fork_failure();
+        *status = 1 << 8;
+        return 0;
+    }
+
+    proc_stats_t *ps = record_child(ctx, cmd, reply.pid, start_ns);
+
+    if (fs_recv_reply(ctx->forkserver_fd, &reply) == -1) {
+        /* Helper died mid-command; the status is lost */
+        fprintf(stderr, "minishell: fork server exited unexpectedly\n");
+        forkserver_stop(ctx);
+        *status = 1 << 8;
+        return 0;
+    }
+
+    if (ps) {
+        ps->launch_ns = reply.launch_ns;
+        finish_child(ctx, ps, reply.status, &reply.usage);
+    }
+    *status = reply.status;
+    return 0;
+}
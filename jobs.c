@@ -0,0 +1,864 @@
+#include "shell.h"
+
+/*
+ * Job control
+ *
+ * Every background pipeline, and every foreground one that gets stopped,
+ * becomes a job. Jobs live in a table indexed by job number, so %n is one
+ * array access, and a pid index (open addressing, like the variable
+ * store) maps a pid reported by wait or waitid straight to its job and
+ * process.
+ *
+ * In an interactive shell each pipeline runs in its own process group.
+ * The foreground group owns the terminal (tcsetpgrp), so Ctrl-C and
+ * Ctrl-Z reach the job rather than the shell, which ignores SIGTSTP,
+ * SIGTTIN and SIGTTOU. Exits are seen through each process's pidfd in the
+ * event loop; stops and continues arrive as SIGCHLD on the signalfd and
+ * are collected with waitid(WSTOPPED | WCONTINUED). Jobs are signalled
+ * through their pidfds, so a recycled pid is never hit.
+ */
+
+#define JOB_PID_INITIAL 32         /* pid index slots, a power of two */
+#define JOB_PID_TOMBSTONE -1       /* Slot of a removed pid */
+
+/**
+ * Hash a pid into the pid index
+ */
+static size_t job_pid_hash(pid_t pid) {
+    return (unsigned int)pid * 2654435761u;
+}
+
+/**
+ * Find the index slot for a pid: its entry, or the empty slot where it
+ * would be inserted (reusing the first tombstone seen on the way)
+ */
+static job_pid_t* job_pid_slot(job_table_t *table, pid_t pid) {
+    size_t mask = table->pid_capacity - 1;
+    size_t i = job_pid_hash(pid) & mask;
+    job_pid_t *reuse = NULL;
+
+    while (1) {
+        job_pid_t *slot = &table->pids[i];
+
+        if (slot->pid == 0) {
+            return reuse ? reuse : slot;
+        }
+        if (slot->pid == JOB_PID_TOMBSTONE) {
+            if (!reuse) reuse = slot;
+        } else if (slot->pid == pid) {
+            return slot;
+        }
+
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * Rehash the pid index into a table of the given capacity
+ */
+static int job_pid_resize(job_table_t *table, size_t capacity) {
+    job_pid_t *old = table->pids;
+    size_t old_capacity = table->pid_capacity;
+
+    job_pid_t *pids = calloc(capacity, sizeof(job_pid_t));
+    if (!pids) {
+        perror("calloc");
+        return -1;
+    }
+
+    table->pids = pids;
+    table->pid_capacity = capacity;
+    table->pid_tombstones = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].pid > 0) {
+            *job_pid_slot(table, old[i].pid) = old[i];
+        }
+    }
+
+    free(old);
+    return 0;
+}
+
+/**
+ * Map a pid to process proc of job id
+ */
+static int job_pid_insert(job_table_t *table, pid_t pid, int id, int proc) {
+    if ((table->pid_count + table->pid_tombstones + 1) * 2 > table->pid_capacity) {
+        size_t capacity = table->pid_capacity ? table->pid_capacity : JOB_PID_INITIAL;
+        while ((table->pid_count + 1) * 2 > capacity / 2) {
+            capacity *= 2;
+        }
+        if (job_pid_resize(table, capacity) == -1) return -1;
+    }
+
+    job_pid_t *slot = job_pid_slot(table, pid);
+    if (slot->pid == JOB_PID_TOMBSTONE) {
+        table->pid_tombstones--;
+    }
+    if (slot->pid != pid) {
+        table->pid_count++;
+    }
+
+    slot->pid = pid;
+    slot->id = id;
+    slot->proc = proc;
+    return 0;
+}
+
+/**
+ * Drop a pid from the index
+ */
+static void job_pid_remove(job_table_t *table, pid_t pid) {
+    if (!table->pid_count) return;
+
+    job_pid_t *slot = job_pid_slot(table, pid);
+    if (slot->pid == pid) {
+        slot->pid = JOB_PID_TOMBSTONE;
+        table->pid_count--;
+        table->pid_tombstones++;
+    }
+}
+
+/**
+ * Look up a job by number
+ */
+job_t* job_get(shell_context_t *ctx, int id) {
+    if (id <= 0 || id > ctx->jobs.highest) return NULL;
+    return ctx->jobs.slots[id];
+}
+
+/**
+ * Look up the job a pid belongs to. *proc is set to its process index.
+ */
+job_t* job_by_pid(shell_context_t *ctx, pid_t pid, int *proc) {
+    job_table_t *table = &ctx->jobs;
+
+    if (!table->pid_count || pid <= 0) return NULL;
+
+    job_pid_t *slot = job_pid_slot(table, pid);
+    if (slot->pid != pid) return NULL;
+
+    *proc = slot->proc;
+    return job_get(ctx, slot->id);
+}
+
+/**
+ * Make a job the current one (%+), demoting the old current to %-
+ */
+static void job_make_current(job_table_t *table, int id) {
+    if (table->current != id) {
+        table->previous = table->current;
+        table->current = id;
+    }
+}
+
+/**
+ * Text of a pipeline for job listings: "cmd args | cmd args"
+ */
+static char* job_text(cmd_node_t *first, int stages) {
+    size_t len = 1;
+    cmd_node_t *cmd = first;
+
+    for (int i = 0; i < stages && cmd; i++, cmd = cmd->next) {
+        len += (cmd->command ? strlen(cmd->command) : 0) + 3;
+        for (int a = 0; a < cmd->argc; a++) {
+            len += strlen(cmd->args[a]) + 1;
+        }
+    }
+
+    char *text = malloc(len);
+    if (!text) {
+        perror("malloc");
+        return NULL;
+    }
+
+    char *p = text;
+    cmd = first;
+    for (int i = 0; i < stages && cmd; i++, cmd = cmd->next) {
+        p += sprintf(p, "%s%s", i ? " | " : "", cmd->command ? cmd->command : "");
+        for (int a = 0; a < cmd->argc; a++) {
+            p += sprintf(p, " %s", cmd->args[a]);
+        }
+    }
+    *p = '\0';
+
+    return text;
+}
+
+/**
+ * Create an empty job for a pipeline and give it the next job number.
+ * pgid is its process group, or 0 without job control.
+ */
+job_t* job_create(shell_context_t *ctx, cmd_node_t *first, int stages, pid_t pgid) {
+    job_table_t *table = &ctx->jobs;
+    int id = table->highest + 1;
+
+    if (id >= table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 16;
+        job_t **slots = realloc(table->slots, capacity * sizeof(job_t *));
+        if (!slots) {
+            perror("realloc");
+            return NULL;
+        }
+        memset(slots + table->capacity, 0, (capacity - table->capacity) * sizeof(job_t *));
+        table->slots = slots;
+        table->capacity = capacity;
+    }
+
+    job_t *job = calloc(1, sizeof(job_t));
+    if (!job) {
+        perror("calloc");
+        return NULL;
+    }
+
+    job->text = job_text(first, stages);
+    if (!job->text) {
+        free(job);
+        return NULL;
+    }
+    job->id = id;
+    job->pgid = pgid;
+    job->state = JOB_RUNNING;
+
+    table->slots[id] = job;
+    table->highest = id;
+    job_make_current(table, id);
+    metrics_jobs(1);
+
+    return job;
+}
+
+/**
+ * Add a running process to a job. The job takes over its pidfd and has
+ * the event loop watch it.
+ */
+int job_add_process(shell_context_t *ctx, job_t *job, pid_t pid, int pidfd) {
+    job_proc_t *procs = realloc(job->procs, (job->nprocs + 1) * sizeof(job_proc_t));
+    if (!procs) {
+        perror("realloc");
+        if (pidfd >= 0) close(pidfd);
+        return -1;
+    }
+    job->procs = procs;
+
+    if (job_pid_insert(&ctx->jobs, pid, job->id, job->nprocs) == -1) {
+        if (pidfd >= 0) close(pidfd);
+        return -1;
+    }
+
+    if (pidfd >= 0 && event_watch_child(ctx, pid, pidfd, 1) == -1) {
+        close(pidfd);
+        pidfd = -1;
+    }
+
+    job_proc_t *proc = &job->procs[job->nprocs++];
+    proc->pid = pid;
+    proc->pidfd = pidfd;
+    proc->state = JOB_RUNNING;
+    proc->status = 0;
+    job->live++;
+
+    return 0;
+}
+
+/**
+ * Remove a job, closing the pidfds of any processes it still has
+ */
+static void job_remove(shell_context_t *ctx, job_t *job) {
+    job_table_t *table = &ctx->jobs;
+
+    for (int i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].pidfd >= 0) {
+            close(job->procs[i].pidfd);
+        }
+        if (job->procs[i].state != JOB_DONE) {
+            job_pid_remove(table, job->procs[i].pid);
+        }
+    }
+
+    table->slots[job->id] = NULL;
+    while (table->highest > 0 && !table->slots[table->highest]) {
+        table->highest--;
+    }
+
+    /* Keep %+ and %- pointing at live jobs, newest first */
+    if (table->previous == job->id) {
+        table->previous = 0;
+    }
+    if (table->current == job->id) {
+        table->current = table->previous;
+        table->previous = 0;
+    }
+    for (int id = table->highest; id > 0 && !(table->current && table->previous); id--) {
+        if (table->slots[id] && id != table->current) {
+            if (!table->current) {
+                table->current = id;
+            } else {
+                table->previous = id;
+            }
+        }
+    }
+
+    metrics_jobs(-1);
+    free(job->procs);
+    free(job->text);
+    free(job);
+}
+
+/**
+ * Recompute a job's state from its processes: done once all are reaped,
+ * stopped if any is stopped
+ */
+static void job_update(shell_context_t *ctx, job_t *job) {
+    int state = JOB_DONE;
+
+    if (job->live > 0) {
+        state = JOB_RUNNING;
+        for (int i = 0; i < job->nprocs; i++) {
+            if (job->procs[i].state == JOB_STOPPED) {
+                state = JOB_STOPPED;
+                break;
+            }
+        }
+    }
+
+    if (state != job->state) {
+        job->state = state;
+        job->notify = 1;
+        if (state == JOB_STOPPED) {
+            job_make_current(&ctx->jobs, job->id);
+        }
+    }
+}
+
+/**
+ * Account for a job process that has been reaped
+ */
+void job_finished(shell_context_t *ctx, pid_t pid, int status) {
+    int p;
+    job_t *job = job_by_pid(ctx, pid, &p);
+
+    metrics_command(status, -1);
+    if (!job) return;
+
+    job_proc_t *proc = &job->procs[p];
+    if (proc->pidfd >= 0) {
+        close(proc->pidfd);
+        proc->pidfd = -1;
+    }
+    proc->state = JOB_DONE;
+    proc->status = status;
+    job->live--;
+    job_pid_remove(&ctx->jobs, pid);
+
+    job_update(ctx, job);
+}
+
+/**
+ * Record that a job process stopped (sig > 0) or continued (sig == 0).
+ * Returns -1 if the pid is not part of a job.
+ */
+int job_stopped(shell_context_t *ctx, pid_t pid, int sig) {
+    int p;
+    job_t *job = job_by_pid(ctx, pid, &p);
+
+    if (!job) return -1;
+
+    job->procs[p].state = sig ? JOB_STOPPED : JOB_RUNNING;
+    if (sig) {
+        job->procs[p].status = W_STOPCODE(sig);
+    }
+    job_update(ctx, job);
+    return 0;
+}
+
+/**
+ * Collect stop and continue notifications after a SIGCHLD. A stop of the
+ * foreground pipeline sets ctx->fg_stopped to the stop signal.
+ */
+void jobs_check_stopped(shell_context_t *ctx) {
+    for (;;) {
+        siginfo_t si;
+
+        si.si_pid = 0;
+        if (waitid(P_ALL, 0, &si, WSTOPPED | WCONTINUED | WNOHANG) == -1 || si.si_pid == 0) {
+            break;
+        }
+
+        int sig = si.si_code == CLD_CONTINUED ? 0 : si.si_status;
+        if (job_stopped(ctx, si.si_pid, sig) == 0 || !sig) continue;
+
+        for (int i = 0; i < ctx->proc_count; i++) {
+            if (ctx->proc_stats[i].pid == si.si_pid && ctx->proc_stats[i].running) {
+                ctx->fg_stopped = sig;
+            }
+        }
+    }
+}
+
+/**
+ * Describe a job's state for listings
+ */
+static const char* job_state_text(job_t *job, char *buf, size_t size) {
+    if (job->state == JOB_RUNNING) return "Running";
+    if (job->state == JOB_STOPPED) return "Stopped";
+
+    /* Done: report how the last process ended */
+    int status = job->procs[job->nprocs - 1].status;
+    if (WIFSIGNALED(status)) return strsignal(WTERMSIG(status));
+    if (WEXITSTATUS(status) == 0) return "Done";
+
+    snprintf(buf, size, "Done(%d)", WEXITSTATUS(status));
+    return buf;
+}
+
+/**
+ * Print one job: "[n]+  State  command"
+ */
+static void job_print(shell_context_t *ctx, job_t *job, int with_pids) {
+    char buf[32];
+    char mark = job->id == ctx->jobs.current ? '+' : job->id == ctx->jobs.previous ? '-' : ' ';
+
+    printf("[%d]%c  ", job->id, mark);
+    if (with_pids) {
+        printf("%d ", job->procs[0].pid);
+    }
+    printf("%-24s%s\n", job_state_text(job, buf, sizeof(buf)), job->text);
+}
+
+/**
+ * Report jobs that finished or stopped since the last call and forget the
+ * finished ones. Only interactive shells print.
+ */
+void jobs_notify(shell_context_t *ctx) {
+    for (int id = 1; id <= ctx->jobs.highest; id++) {
+        job_t *job = ctx->jobs.slots[id];
+
+        if (!job || !job->notify) continue;
+
+        if (ctx->interactive) {
+            job_print(ctx, job, 0);
+        }
+        job->notify = 0;
+        if (job->state == JOB_DONE) {
+            job_remove(ctx, job);
+        }
+    }
+    fflush(stdout);
+}
+
+/**
+ * Send a signal to every live process of a job through its pidfd
+ */
+static int job_signal(job_t *job, int sig) {
+    int result = 0;
+
+    for (int i = 0; i < job->nprocs; i++) {
+        job_proc_t *proc = &job->procs[i];
+        if (proc->state != JOB_DONE && signal_child(proc->pid, proc->pidfd, sig) == -1) {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Resolve a job spec (%n, %%, %+, %-, %prefix, or none for the current
+ * job), printing an error for cmd if there is no such job
+ */
+static job_t* job_spec(shell_context_t *ctx, const char *spec, const char *cmd) {
+    job_t *job = NULL;
+
+    if (!spec || strcmp(spec, "%") == 0 || strcmp(spec, "%%") == 0 ||
+        strcmp(spec, "%+") == 0) {
+        job = job_get(ctx, ctx->jobs.current);
+    } else if (strcmp(spec, "%-") == 0) {
+        job = job_get(ctx, ctx->jobs.previous);
+    } else if (spec[0] == '%' && spec[1] >= '0' && spec[1] <= '9') {
+        job = job_get(ctx, atoi(spec + 1));
+    } else if (spec[0] == '%') {
+        size_t len = strlen(spec + 1);
+        for (int id = 1; id <= ctx->jobs.highest; id++) {
+            job_t *j = ctx->jobs.slots[id];
+            if (j && strncmp(j->text, spec + 1, len) == 0) {
+                if (job) {
+                    fprintf(stderr, "%s: %s: ambiguous job spec\n", cmd, spec);
+                    return NULL;
+                }
+                job = j;
+            }
+        }
+    }
+
+    if (!job) {
+        fprintf(stderr, "%s: %s: no such job\n", cmd, spec ? spec : "current");
+    }
+    return job;
+}
+
+/**
+ * Take the terminal back after a foreground job finished or stopped
+ */
+void job_reclaim_terminal(shell_context_t *ctx) {
+    if (ctx->fg_pgid) {
+        tcsetpgrp(STDIN_FILENO, ctx->shell_pgid);
+        ctx->fg_pgid = 0;
+    }
+}
+
+/**
+ * Stop waiting for a foreground job that was stopped: save its terminal
+ * modes, take the terminal back and tell the user
+ */
+static int job_suspend(shell_context_t *ctx, job_t *job, int sig) {
+    job->has_tmodes = tcgetattr(STDIN_FILENO, &job->tmodes) == 0;
+    job_reclaim_terminal(ctx);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &ctx->shell_tmodes);
+
+    printf("\n");
+    job_print(ctx, job, 0);
+    job->notify = 0;
+    return 128 + sig;
+}
+
+/**
+ * Turn the stopped foreground pipeline into a job. Its unreaped processes
+ * move from ctx->proc_stats into the job table. Returns the exit status
+ * for the pipeline (128 plus the stop signal).
+ */
+int job_stop_foreground(shell_context_t *ctx, cmd_node_t *first, int stages) {
+    int sig = ctx->fg_stopped;
+    job_t *job = job_create(ctx, first, stages, ctx->fg_pgid);
+
+    ctx->fg_stopped = 0;
+
+    for (int i = 0; i < ctx->proc_count; i++) {
+        proc_stats_t *ps = &ctx->proc_stats[i];
+        if (!ps->running) continue;
+
+        /* The terminal stops the whole group, not just the one we saw */
+        if (job && job_add_process(ctx, job, ps->pid, ps->pidfd) == 0) {
+            job_stopped(ctx, ps->pid, sig);
+        }
+        ps->pidfd = -1;
+        ps->running = 0;
+
+        /* A deadline doesn't follow the pipeline into the job table */
+        if (ps->timer_fd >= 0) {
+            close(ps->timer_fd);
+            ps->timer_fd = -1;
+        }
+    }
+
+    if (!job) {
+        job_reclaim_terminal(ctx);
+        return 128 + sig;
+    }
+    return job_suspend(ctx, job, sig);
+}
+
+/**
+ * Announce a job that was just started in the background
+ */
+void job_started(shell_context_t *ctx, job_t *job) {
+    if (ctx->interactive) {
+        printf("[%d] %d\n", job->id, job->procs[job->nprocs - 1].pid);
+    }
+}
+
+/**
+ * Process group setup in a forked child, before exec. pgid is the
+ * pipeline's group, or 0 to start a new one.
+ */
+void job_launch_child(shell_context_t *ctx, pid_t pgid, int foreground) {
+    if (!ctx->job_control) return;
+
+    /* The parent does the same; whichever runs first wins the race */
+    setpgid(0, pgid);
+    if (foreground) {
+        tcsetpgrp(STDIN_FILENO, pgid ? pgid : getpid());
+    }
+
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+}
+
+/**
+ * Process group setup in the shell after forking a pipeline process
+ */
+void job_launch_parent(shell_context_t *ctx, pid_t pid, pid_t pgid, int foreground) {
+    if (!ctx->job_control) return;
+
+    if (!pgid) pgid = pid;
+    setpgid(pid, pgid);
+    if (foreground && ctx->fg_pgid != pgid) {
+        tcsetpgrp(STDIN_FILENO, pgid);
+        ctx->fg_pgid = pgid;
+    }
+}
+
+/**
+ * Enable job control for an interactive shell: wait until we own the
+ * terminal, move into our own process group and take the terminal
+ */
+void jobs_init(shell_context_t *ctx) {
+    /* Stops and continues are only seen through the event loop */
+    if (!ctx->interactive || ctx->epoll_fd < 0) return;
+
+    while (tcgetpgrp(STDIN_FILENO) != (ctx->shell_pgid = getpgrp())) {
+        kill(-ctx->shell_pgid, SIGTTIN);
+    }
+
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    /* Fails harmlessly if we already lead a session */
+    setpgid(0, 0);
+    ctx->shell_pgid = getpgrp();
+    if (tcsetpgrp(STDIN_FILENO, ctx->shell_pgid) == -1) {
+        perror("tcsetpgrp");
+        return;
+    }
+
+    tcgetattr(STDIN_FILENO, &ctx->shell_tmodes);
+    ctx->job_control = 1;
+}
+
+/**
+ * Forget all jobs, closing their pidfds
+ */
+void jobs_free(shell_context_t *ctx) {
+    for (int id = 1; id <= ctx->jobs.highest; id++) {
+        if (ctx->jobs.slots[id]) {
+            job_remove(ctx, ctx->jobs.slots[id]);
+        }
+    }
+
+    free(ctx->jobs.slots);
+    free(ctx->jobs.pids);
+    memset(&ctx->jobs, 0, sizeof(ctx->jobs));
+}
+
+/**
+ * Built-in jobs command: jobs [-l | -p]
+ */
+int builtin_jobs(char **args, shell_context_t *ctx) {
+    int with_pids = 0, pids_only = 0;
+
+    for (int i = 0; args && args[i]; i++) {
+        if (strcmp(args[i], "-l") == 0) {
+            with_pids = 1;
+        } else if (strcmp(args[i], "-p") == 0) {
+            pids_only = 1;
+        } else {
+            fprintf(stderr, "jobs: %s: invalid option\n", args[i]);
+            return 2;
+        }
+    }
+
+    for (int id = 1; id <= ctx->jobs.highest; id++) {
+        job_t *job = ctx->jobs.slots[id];
+        if (!job) continue;
+
+        if (pids_only) {
+            printf("%d\n", job->pgid ? job->pgid : job->procs[0].pid);
+        } else {
+            job_print(ctx, job, with_pids);
+            job->notify = 0;
+        }
+    }
+
+    /* Listed finished jobs are gone afterwards */
+    for (int id = 1; id <= ctx->jobs.highest; id++) {
+        job_t *job = ctx->jobs.slots[id];
+        if (job && job->state == JOB_DONE && !job->notify) {
+            job_remove(ctx, job);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Built-in fg command: continue a job in the foreground and wait for it
+ */
+int builtin_fg(char **args, shell_context_t *ctx) {
+    if (!ctx->job_control) {
+        fprintf(stderr, "fg: no job control\n");
+        return 1;
+    }
+
+    job_t *job = job_spec(ctx, args ? args[0] : NULL, "fg");
+    if (!job) return 1;
+
+    printf("%s\n", job->text);
+    fflush(stdout);
+
+    tcsetpgrp(STDIN_FILENO, job->pgid);
+    ctx->fg_pgid = job->pgid;
+    if (job->state == JOB_STOPPED) {
+        if (job->has_tmodes) {
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+        }
+        job_signal(job, SIGCONT);
+        for (int i = 0; i < job->nprocs; i++) {
+            if (job->procs[i].state == JOB_STOPPED) job->procs[i].state = JOB_RUNNING;
+        }
+        job_update(ctx, job);
+    }
+    job_make_current(&ctx->jobs, job->id);
+
+    /* Exits arrive as pidfd events, stops as SIGCHLD */
+    while (job->state == JOB_RUNNING) {
+        event_wait_jobs(ctx);
+    }
+
+    /* Ctrl-C went to the job, not to us */
+    ctx->interrupted = 0;
+
+    if (job->state == JOB_STOPPED) {
+        int sig = SIGTSTP;
+        for (int i = 0; i < job->nprocs; i++) {
+            if (job->procs[i].state == JOB_STOPPED) sig = WSTOPSIG(job->procs[i].status);
+        }
+        return job_suspend(ctx, job, sig);
+    }
+
+    job_reclaim_terminal(ctx);
+    int status = exit_code(job->procs[job->nprocs - 1].status);
+    job_remove(ctx, job);
+    return status;
+}
+
+/**
+ * Built-in bg command: continue a stopped job in the background
+ */
+int builtin_bg(char **args, shell_context_t *ctx) {
+    if (!ctx->job_control) {
+        fprintf(stderr, "bg: no job control\n");
+        return 1;
+    }
+
+    job_t *job = job_spec(ctx, args ? args[0] : NULL, "bg");
+    if (!job) return 1;
+
+    if (job->state != JOB_STOPPED) {
+        fprintf(stderr, "bg: job %d already in background\n", job->id);
+        return 0;
+    }
+
+    job_signal(job, SIGCONT);
+    for (int i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == JOB_STOPPED) job->procs[i].state = JOB_RUNNING;
+    }
+    job_update(ctx, job);
+    job->notify = 0;
+
+    printf("[%d]%c %s &\n", job->id, job->id == ctx->jobs.current ? '+' : ' ', job->text);
+    return 0;
+}
+
+/* Signal names accepted by kill, without the SIG prefix */
+static const struct {
+    const char *name;
+    int sig;
+} signal_names[] = {
+    {"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+    {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+    {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {"WINCH", SIGWINCH},
+};
+
+#define SIGNAL_NAMES ((int)(sizeof(signal_names) / sizeof(signal_names[0])))
+
+/**
+ * Parse a signal number or name (with or without SIG). Returns -1 if
+ * unknown.
+ */
+static int signal_number(const char *spec) {
+    if (spec[0] >= '0' && spec[0] <= '9') {
+        char *end;
+        long sig = strtol(spec, &end, 10);
+        return *end == '\0' && sig < NSIG ? (int)sig : -1;
+    }
+
+    if (strncmp(spec, "SIG", 3) == 0) {
+        spec += 3;
+    }
+    for (int i = 0; i < SIGNAL_NAMES; i++) {
+        if (strcmp(spec, signal_names[i].name) == 0) {
+            return signal_names[i].sig;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Built-in kill command: kill [-s SIG | -SIG] pid | %job ..., or kill -l
+ */
+int builtin_kill(char **args, shell_context_t *ctx) {
+    int sig = SIGTERM;
+    int i = 0;
+    int status = 0;
+
+    if (!args || !args[0]) {
+        fprintf(stderr, "kill: usage: kill [-s sigspec | -sigspec] pid | %%job ... or kill -l\n");
+        return 2;
+    }
+
+    if (strcmp(args[0], "-l") == 0) {
+        for (int n = 0; n < SIGNAL_NAMES; n++) {
+            printf("%2d) SIG%s\n", signal_names[n].sig, signal_names[n].name);
+        }
+        return 0;
+    }
+
+    if (strcmp(args[0], "-s") == 0 && args[1]) {
+        sig = signal_number(args[1]);
+        i = 2;
+    } else if (args[0][0] == '-' && args[0][1]) {
+        sig = signal_number(args[0] + 1);
+        i = 1;
+    }
+    if (sig < 0) {
+        fprintf(stderr, "kill: %s: invalid signal specification\n", args[i - 1]);
+        return 1;
+    }
+
+    for (; args[i]; i++) {
+        if (args[i][0] == '%') {
+            job_t *job = job_spec(ctx, args[i], "kill");
+            if (!job) {
+                status = 1;
+                continue;
+            }
+            if (job_signal(job, sig) == -1) {
+                perror("kill");
+                status = 1;
+            }
+            /* A stopped job has to run to act on a terminating signal */
+            if (job->state == JOB_STOPPED && sig != SIGSTOP && sig != SIGTSTP &&
+                sig != SIGCONT) {
+                job_signal(job, SIGCONT);
+            }
+            continue;
+        }
+
+        char *end;
+        long pid = strtol(args[i], &end, 10);
+        if (*end != '\0' || end == args[i]) {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", args[i]);
+            status = 1;
+        } else if (kill((pid_t)pid, sig) == -1) {
+            fprintf(stderr, "kill: (%ld) - %s\n", pid, strerror(errno));
+            status = 1;
+        }
+    }
+
+    return status;
+}
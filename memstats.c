@@ -0,0 +1,93 @@
+#include "shell.h"
+
+#include <malloc.h>
+
+/*
+ * Memory accounting
+ *
+ * The parser and command chain code (shell.c, command.c) allocate through
+ * shell_malloc and shell_free, which keep running counts in shell_mem.
+ * Live bytes are tracked with malloc_usable_size so frees need no size
+ * header. The `meminfo` builtin reports these next to the process RSS and
+ * glibc's own heap figures, which makes slow leaks in long-lived sessions
+ * visible as growth between calls.
+ */
+
+mem_stats_t shell_mem;
+
+/**
+ * Allocate memory, counting it
+ */
+void* shell_malloc(size_t size) {
+    void *ptr = malloc(size);
+
+    if (ptr) {
+        shell_mem.allocs++;
+        shell_mem.live_blocks++;
+        shell_mem.live_bytes += malloc_usable_size(ptr);
+    }
+
+    return ptr;
+}
+
+/**
+ * Free memory from shell_malloc
+ */
+void shell_free(void *ptr) {
+    if (!ptr) return;
+
+    shell_mem.frees++;
+    shell_mem.live_blocks--;
+    shell_mem.live_bytes -= malloc_usable_size(ptr);
+    free(ptr);
+}
+
+/**
+ * Start a new input line: the counts since the last mark become the
+ * "last line" figures
+ */
+void mem_line_mark(void) {
+    shell_mem.last_line_allocs = shell_mem.allocs - shell_mem.line_start_allocs;
+    shell_mem.line_start_allocs = shell_mem.allocs;
+}
+
+/**
+ * Resident set size in kB from /proc/self/statm, or -1
+ */
+static long read_rss_kb(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    long size, resident;
+
+    if (!f) return -1;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+        resident = -1;
+    }
+    fclose(f);
+
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Built-in meminfo command: the shell's memory footprint
+ */
+int builtin_meminfo(char **args, shell_context_t *ctx) {
+    (void)args;
+    (void)ctx;
+
+    struct mallinfo2 mi = mallinfo2();
+    long rss = read_rss_kb();
+
+    if (rss >= 0) {
+        printf("rss            %10ld kB\n", rss);
+    }
+    printf("heap in use    %10zu kB\n", mi.uordblks / 1024);
+    printf("arena          %10zu kB  (%zu kB mmapped)\n",
+           (mi.arena + mi.hblkhd) / 1024, mi.hblkhd / 1024);
+    printf("shell live     %10zu B   in %zu blocks\n",
+           shell_mem.live_bytes, shell_mem.live_blocks);
+    printf("cmd nodes live %10zu\n", shell_mem.live_nodes);
+    printf("allocations    %10llu total, %llu freed, %llu last line\n",
+           shell_mem.allocs, shell_mem.frees, shell_mem.last_line_allocs);
+
+    return 0;
+}
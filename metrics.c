@@ -0,0 +1,314 @@
+#include "shell.h"
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/*
+ * Prometheus metrics
+ *
+ * With MINISHELL_METRICS_SOCKET=<path> set, a background thread listens
+ * on a unix stream socket and answers every connection with the shell's
+ * counters in Prometheus text format: commands run, fork failures, exit
+ * code distribution, a launch latency histogram and the number of
+ * background jobs still running. Clients that send an HTTP request (e.g.
+ * curl --unix-socket) get an HTTP response; anything else gets the bare
+ * text.
+ *
+ * Counters are updated with relaxed atomics from the shell thread and
+ * only read by the server thread. The server never allocates or takes a
+ * lock, so a fork from the shell thread can't inherit a held malloc lock.
+ */
+
+#define METRICS_BODY_MAX 16384
+#define METRICS_REQUEST_WAIT_MS 100
+
+/* Launch latency bucket upper bounds in ns, and as Prometheus labels */
+static const long long launch_bounds_ns[] = {
+    100000, 250000, 500000, 1000000, 2500000,
+    5000000, 10000000, 25000000, 50000000, 100000000
+};
+static const char *const launch_bounds_label[] = {
+    "0.0001", "0.00025", "0.0005", "0.001", "0.0025",
+    "0.005", "0.01", "0.025", "0.05", "0.1"
+};
+#define LAUNCH_BUCKETS (int)(sizeof(launch_bounds_ns) / sizeof(launch_bounds_ns[0]))
+
+typedef struct {
+    uint64_t commands;                      /* Commands completed */
+    uint64_t fork_failures;                 /* fork() or helper spawn errors */
+    uint64_t exit_codes[256];               /* Completions per exit status */
+    uint64_t launch_buckets[LAUNCH_BUCKETS + 1]; /* Non-cumulative, last is +Inf */
+    uint64_t launch_count;
+    uint64_t launch_sum_ns;
+    int64_t jobs;                           /* Background jobs running */
+} metrics_t;
+
+static metrics_t metrics;
+static int metrics_fd = -1;
+static char metrics_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static pid_t metrics_owner;
+
+static void counter_add(uint64_t *counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static uint64_t counter_get(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/**
+ * Count a finished command. status is a raw wait status for children or
+ * an exit code shifted left by 8 for builtins; launch_ns is -1 if unknown.
+ */
+void metrics_command(int status, long long launch_ns) {
+    counter_add(&metrics.commands, 1);
+    counter_add(&metrics.exit_codes[exit_code(status) & 0xff], 1);
+
+    if (launch_ns >= 0) {
+        int b = 0;
+        while (b < LAUNCH_BUCKETS && launch_ns > launch_bounds_ns[b]) {
+            b++;
+        }
+        counter_add(&metrics.launch_buckets[b], 1);
+        counter_add(&metrics.launch_count, 1);
+        counter_add(&metrics.launch_sum_ns, (uint64_t)launch_ns);
+    }
+}
+
+/**
+ * Count a failed attempt to start a process
+ */
+void metrics_fork_failure(void) {
+    counter_add(&metrics.fork_failures, 1);
+}
+
+/**
+ * Track the number of background jobs: +1 when started, -1 when reaped
+ */
+void metrics_jobs(int delta) {
+    __atomic_fetch_add(&metrics.jobs, delta, __ATOMIC_RELAXED);
+}
+
+/**
+ * Append formatted text to the response body, dropping it if full
+ */
+static void body_printf(char *body, size_t *len, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(body + *len, METRICS_BODY_MAX - *len, fmt, ap);
+    va_end(ap);
+
+    if (n > 0 && *len + n < METRICS_BODY_MAX) {
+        *len += n;
+    }
+}
+
+/**
+ * Render all metrics in Prometheus text format. Integer formatting only,
+ * so no allocation happens here.
+ */
+static size_t metrics_render(char *body) {
+    size_t len = 0;
+
+    body_printf(body, &len,
+                "# HELP minishell_commands_total Commands completed.\n"
+                "# TYPE minishell_commands_total counter\n"
+                "minishell_commands_total %llu\n",
+                (unsigned long long)counter_get(&metrics.commands));
+
+    body_printf(body, &len,
+                "# HELP minishell_fork_failures_total Failed attempts to start a process.\n"
+                "# TYPE minishell_fork_failures_total counter\n"
+                "minishell_fork_failures_total %llu\n",
+                (unsigned long long)counter_get(&metrics.fork_failures));
+
+    body_printf(body, &len,
+                "# HELP minishell_command_exit_total Commands completed by exit status.\n"
+                "# TYPE minishell_command_exit_total counter\n");
+    for (int code = 0; code < 256; code++) {
+        uint64_t n = counter_get(&metrics.exit_codes[code]);
+        if (n) {
+            body_printf(body, &len, "minishell_command_exit_total{code=\"%d\"} %llu\n",
+                        code, (unsigned long long)n);
+        }
+    }
+
+    body_printf(body, &len,
+                "# HELP minishell_launch_seconds Time from fork to successful exec.\n"
+                "# TYPE minishell_launch_seconds histogram\n");
+    uint64_t cumulative = 0;
+    for (int b = 0; b <= LAUNCH_BUCKETS; b++) {
+        cumulative += counter_get(&metrics.launch_buckets[b]);
+        body_printf(body, &len, "minishell_launch_seconds_bucket{le=\"%s\"} %llu\n",
+                    b < LAUNCH_BUCKETS ? launch_bounds_label[b] : "+Inf",
+                    (unsigned long long)cumulative);
+    }
+    uint64_t sum = counter_get(&metrics.launch_sum_ns);
+    body_printf(body, &len,
+                "minishell_launch_seconds_sum %llu.%09llu\n"
+                "minishell_launch_seconds_count %llu\n",
+                (unsigned long long)(sum / 1000000000ULL),
+                (unsigned long long)(sum % 1000000000ULL),
+                (unsigned long long)counter_get(&metrics.launch_count));
+
+    body_printf(body, &len,
+                "# HELP minishell_background_jobs Background jobs still running.\n"
+                "# TYPE minishell_background_jobs gauge\n"
+                "minishell_background_jobs %lld\n",
+                (long long)__atomic_load_n(&metrics.jobs, __ATOMIC_RELAXED));
+
+    return len;
+}
+
+/**
+ * Write a whole buffer to a client, giving up on error
+ */
+static void send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/**
+ * Answer one client
+ */
+static void metrics_serve(int client) {
+    static char body[METRICS_BODY_MAX];
+    char request[512];
+    ssize_t got = 0;
+
+    /* Give an HTTP client a moment to send its request line */
+    struct pollfd pfd = {client, POLLIN, 0};
+    if (poll(&pfd, 1, METRICS_REQUEST_WAIT_MS) > 0) {
+        got = recv(client, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+
+    size_t len = metrics_render(body);
+
+    if (got >= 4 && memcmp(request, "GET ", 4) == 0) {
+        char header[128];
+        int n = snprintf(header, sizeof(header),
+                         "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\n\r\n", len);
+        send_all(client, header, n);
+    }
+    send_all(client, body, len);
+}
+
+/**
+ * Server thread: accept and answer clients until the process exits
+ */
+static void *metrics_thread(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        int client = accept4(metrics_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("metrics: accept");
+            return NULL;
+        }
+
+        metrics_serve(client);
+        close(client);
+    }
+}
+
+/**
+ * Remove path if it is a socket. Returns 0 if it was removed or didn't
+ * exist, or -1 with errno EADDRINUSE if something else is there, which
+ * is never deleted.
+ */
+static int unlink_socket(const char *path) {
+    struct stat st;
+
+    if (lstat(path, &st) == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        errno = EADDRINUSE;
+        return -1;
+    }
+    return unlink(path);
+}
+
+/**
+ * Remove the socket file at exit (in the shell itself, not its children)
+ */
+static void metrics_stop(void) {
+    if (metrics_fd >= 0 && getpid() == metrics_owner) {
+        unlink_socket(metrics_path);
+    }
+}
+
+/**
+ * Start serving metrics on a unix socket. Returns 0 on success.
+ */
+int metrics_start(const char *path) {
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "minishell: %s: metrics socket path too long\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("metrics: socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A stale socket from an earlier shell would make bind fail */
+    if (unlink_socket(path) == -1) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 8) == -1) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    metrics_fd = fd;
+    strcpy(metrics_path, path);
+    metrics_owner = getpid();
+
+    /* Keep signals on the shell thread */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, metrics_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        fprintf(stderr, "minishell: metrics thread: %s\n", strerror(err));
+        close(fd);
+        unlink_socket(path);
+        metrics_fd = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+    fork_pidfd_threaded();
+
+    atexit(metrics_stop);
+    return 0;
+}
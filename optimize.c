@@ -0,0 +1,507 @@
+#include "shell.h"
+
+#include <sys/stat.h>
+
+/*
+ * Chain optimizer
+ *
+ * With `set -o optimize`, execute_command_chain() rewrites a parsed
+ * chain before running it. Pipeline stages that only move bytes around
+ * are removed:
+ *
+ *     cat FILE | cmd      ->  cmd < FILE
+ *     echo WORDS | cmd    ->  cmd <<< 'WORDS'
+ *     a | cat | b         ->  a | b
+ *
+ * A rewrite is only made when it can't change what the pipeline does:
+ * FILE must be a readable regular file when the chain starts and the
+ * cat must be in its first pipeline (an earlier command could create or
+ * remove FILE), the stage taking over must not redirect that stream
+ * itself, and the cat or echo must be plain (no options, no
+ * redirections of its own). A cat at the end of a pipeline is kept: its
+ * exit status is the pipeline's, and it keeps the previous stage's
+ * output away from the terminal. Nothing is
+ * folded into a builtin that would be left on its own: in a pipeline it
+ * runs in a subshell, alone it would run in the shell itself (so
+ * `echo x | exit 3` or `echo x | cd /` would affect the shell).
+ *
+ * At the start of an AND-OR list, `true` and `false` are folded into
+ * the connectors after them (dropping branches that can't run), and
+ * `export a; export b` (or unset, readonly) becomes one call. Finally
+ * every external command up to the first cd/export-like builtin has its
+ * PATH lookup done once per distinct name.
+ *
+ * `explain 'line'` prints the plan for a line and each rewrite made.
+ */
+
+/**
+ * Whether a node runs the named command
+ */
+static int is_command(const cmd_node_t *node, const char *name) {
+    return node->command && strcmp(node->command, name) == 0;
+}
+
+/**
+ * Whether a node has any redirection
+ */
+static int redirected(const cmd_node_t *node) {
+    return node->input_file || node->input_string || node->output_file;
+}
+
+/**
+ * A cat that copies stdin to stdout and nothing else
+ */
+static int passthrough_cat(const cmd_node_t *node) {
+    return is_command(node, "cat") && !redirected(node) &&
+           (node->argc == 0 || (node->argc == 1 && strcmp(node->args[0], "-") == 0));
+}
+
+/**
+ * The file a first-stage cat reads, if it reads exactly one readable
+ * regular file (`cat FILE` or `cat < FILE`), else NULL
+ */
+static char **cat_source(cmd_node_t *node) {
+    char **file;
+    struct stat st;
+
+    if (!is_command(node, "cat") || node->output_file || node->input_string) return NULL;
+
+    if (node->argc == 1 && !node->input_file && node->args[0][0] != '-') {
+        file = &node->args[0];
+    } else if (node->argc == 0 && node->input_file) {
+        file = &node->input_file;
+    } else {
+        return NULL;
+    }
+
+    if (stat(*file, &st) == -1 || !S_ISREG(st.st_mode) || access(*file, R_OK) == -1) {
+        return NULL;
+    }
+    return file;
+}
+
+/**
+ * The words a first-stage echo prints, joined by spaces, or NULL if it
+ * isn't a plain builtin echo (or out of memory)
+ */
+static char *echo_text(cmd_node_t *node) {
+    size_t len = 0;
+
+    if (!is_command(node, "echo") || cmd_builtin_id(node) == BUILTIN_NONE ||
+        redirected(node) || (node->argc > 0 && strcmp(node->args[0], "-n") == 0)) {
+        return NULL;
+    }
+
+    for (int i = 0; i < node->argc; i++) {
+        len += strlen(node->args[i]) + 1;
+    }
+
+    char *text = shell_malloc(len + 1);
+    if (!text) return NULL;
+
+    char *p = text;
+    for (int i = 0; i < node->argc; i++) {
+        if (i > 0) *p++ = ' ';
+        size_t n = strlen(node->args[i]);
+        memcpy(p, node->args[i], n);
+        p += n;
+    }
+    *p = '\0';
+    return text;
+}
+
+/**
+ * Fold the first stage of a pipeline into the second's stdin when it is
+ * `cat FILE` or `echo WORDS`. *link points at the first stage; `cat FILE`
+ * is only folded when chain_start is set, as FILE was checked before
+ * anything ran. Returns 1 if the stage was removed.
+ */
+static int fold_source(cmd_node_t **link, int chain_start, FILE *notes) {
+    cmd_node_t *src = *link;
+    cmd_node_t *dst = src->next;
+    char **file;
+    char *text = NULL;
+
+    if (dst->input_file || dst->input_string) return 0;
+
+    /* A builtin taking over a two-stage pipeline would leave its subshell */
+    if (dst->type != CMD_PIPE && cmd_builtin_id(dst) != BUILTIN_NONE) return 0;
+
+    if (chain_start && (file = cat_source(src)) != NULL) {
+        if (notes) {
+            fprintf(notes, "rewrite: cat %s | %s -> %s < %s\n",
+                    *file, dst->command, dst->command, *file);
+        }
+        dst->input_file = *file;
+        *file = NULL;
+    } else if ((text = echo_text(src)) != NULL) {
+        if (notes) {
+            fprintf(notes, "rewrite: echo | %s -> %s <<< '%s'\n",
+                    dst->command, dst->command, text);
+        }
+        dst->input_string = text;
+    } else {
+        return 0;
+    }
+
+    /* 'time' covers the whole pipeline, so it moves to the new first stage */
+    dst->timed = src->timed;
+    *link = dst;
+    free_cmd_node(src);
+    return 1;
+}
+
+/**
+ * Remove pass-through stages from the pipeline starting at *link:
+ * a | cat | b, then cat FILE | cmd and echo WORDS | cmd. Returns the
+ * number of rewrites.
+ */
+static int fold_stages(command_chain_t *chain, cmd_node_t **link, FILE *notes) {
+    int rewrites = 0;
+
+    /* a | cat | b -> a | b */
+    cmd_node_t *stage = *link;
+    while (stage->type == CMD_PIPE && stage->next) {
+        cmd_node_t *cat = stage->next;
+        if (cat->type != CMD_PIPE || !cat->next || !passthrough_cat(cat) ||
+            stage->output_file) {
+            stage = cat;
+            continue;
+        }
+        if (notes) {
+            fprintf(notes, "rewrite: %s | cat | %s -> %s | %s\n", stage->command,
+                    cat->next->command, stage->command, cat->next->command);
+        }
+        stage->next = cat->next;
+        free_cmd_node(cat);
+        chain->count--;
+        rewrites++;
+    }
+
+    /* cat FILE | cmd, echo WORDS | cmd; repeated for cat | cat | ... */
+    int chain_start = link == &chain->head;
+    while ((*link)->type == CMD_PIPE && (*link)->next &&
+           fold_source(link, chain_start, notes)) {
+        chain->count--;
+        rewrites++;
+    }
+
+    return rewrites;
+}
+
+/**
+ * Last node of the pipeline starting at node
+ */
+static cmd_node_t *pipeline_end(cmd_node_t *node) {
+    while (node->type == CMD_PIPE && node->next) {
+        node = node->next;
+    }
+    return node;
+}
+
+/**
+ * Exit status of a pipeline that is a bare `true` or `false`, else -1
+ */
+static int constant_status(const cmd_node_t *node) {
+    if (node->type == CMD_PIPE || node->argc > 0 || redirected(node) ||
+        node->background || node->timed) {
+        return -1;
+    }
+    if (is_command(node, "true")) return 0;
+    if (is_command(node, "false")) return 1;
+    return -1;
+}
+
+/**
+ * Whether a status makes connector op skip the pipeline after it
+ */
+static int skips_next(cmd_type_t op, int status) {
+    return (op == CMD_AND && status != 0) || (op == CMD_OR && status == 0);
+}
+
+/**
+ * Fold a constant at the start of an AND-OR list (*link):
+ *
+ *     true && a   ->  a           false || a   ->  a
+ *     true || a   ->  true        false && a   ->  false
+ *     true; a     ->  a
+ *
+ * Pipelines the constant makes unreachable are dropped with it, up to
+ * the first one its status would run. A constant after && or || is
+ * left alone, since whether it runs depends on what came before.
+ * Returns 1 if the chain changed.
+ */
+static int fold_constant(command_chain_t *chain, cmd_node_t **link, FILE *notes) {
+    cmd_node_t *node = *link;
+    int status = constant_status(node);
+
+    /* The last command's status is the line's */
+    if (status < 0 || !node->next) return 0;
+
+    if (node->type == CMD_SEMICOLON || !skips_next(node->type, status)) {
+        if (notes) {
+            fprintf(notes, "rewrite: %s %s %s -> %s\n", node->command,
+                    node->type == CMD_AND ? "&&" : node->type == CMD_OR ? "||" : ";",
+                    node->next->command, node->next->command);
+        }
+        *link = node->next;
+        free_cmd_node(node);
+        chain->count--;
+        return 1;
+    }
+
+    /* Drop what the constant skips; its connector becomes the last skipped one's */
+    cmd_node_t *next = node->next;
+    cmd_type_t op;
+    do {
+        cmd_node_t *end = pipeline_end(next);
+        cmd_node_t *after = end->next;
+        op = end->type;
+
+        if (notes) {
+            fprintf(notes, "rewrite: %s %s %s -> %s (unreachable)\n", node->command,
+                    node->type == CMD_AND ? "&&" : "||", next->command, node->command);
+        }
+        while (next != after) {
+            cmd_node_t *dead = next;
+            next = next->next;
+            free_cmd_node(dead);
+            chain->count--;
+        }
+    } while (next && skips_next(op, status));
+
+    node->next = next;
+    node->type = op;
+    return 1;
+}
+
+/**
+ * Builtins whose argument lists can be concatenated
+ */
+static int mergeable_builtin(cmd_node_t *node) {
+    if (!is_command(node, "export") && !is_command(node, "unset") &&
+        !is_command(node, "readonly")) {
+        return 0;
+    }
+    if (cmd_builtin_id(node) == BUILTIN_NONE || node->argc == 0 ||
+        redirected(node) || node->background || node->timed ||
+        node->type == CMD_PIPE) {
+        return 0;
+    }
+    for (int i = 0; i < node->argc; i++) {
+        if (node->args[i][0] == '-') return 0;
+    }
+    return 1;
+}
+
+/**
+ * Merge `export a; export b` (likewise unset and readonly) into one
+ * `export a b` when node starts an AND-OR list. Returns 1 if it merged.
+ */
+static int merge_builtins(command_chain_t *chain, cmd_node_t *node, FILE *notes) {
+    cmd_node_t *next = node->next;
+
+    /* next's status must not be tested, since the merged one covers both */
+    if (!next || node->type != CMD_SEMICOLON || next->type == CMD_AND ||
+        next->type == CMD_OR || !mergeable_builtin(node) ||
+        !mergeable_builtin(next) || strcmp(node->command, next->command) != 0) {
+        return 0;
+    }
+
+    char **args = shell_malloc((node->argc + next->argc + 1) * sizeof(char *));
+    if (!args) return 0;
+
+    memcpy(args, node->args, node->argc * sizeof(char *));
+    memcpy(args + node->argc, next->args, (next->argc + 1) * sizeof(char *));
+    if (notes) {
+        fprintf(notes, "rewrite: %s; %s -> one %s\n", node->command, next->command,
+                node->command);
+    }
+
+    shell_free(node->args);
+    node->args = args;
+    node->argc += next->argc;
+    node->type = next->type;
+    node->next = next->next;
+
+    /* The strings now belong to node */
+    next->argc = 0;
+    free_cmd_node(next);
+    chain->count--;
+    return 1;
+}
+
+/**
+ * Resolve every external command up front, each distinct name once,
+ * stopping at the first builtin that can change PATH or the directory
+ */
+static void hoist_paths(command_chain_t *chain, shell_context_t *ctx, FILE *notes) {
+    for (cmd_node_t *node = chain->head; node; node = node->next) {
+        int id = cmd_builtin_id(node);
+
+        if (id != BUILTIN_NONE) {
+            const builtin_t *builtin = get_builtin(id);
+            if (builtin && (builtin->flags & BUILTIN_SPECIAL)) break;
+            continue;
+        }
+        if (node->path || !node->command) continue;
+
+        for (cmd_node_t *prev = chain->head; prev != node; prev = prev->next) {
+            if (prev->path && strcmp(prev->command, node->command) == 0) {
+                node->path = shell_strdup(prev->path);
+                break;
+            }
+        }
+        if (!node->path && resolve_command(node, ctx) && notes) {
+            fprintf(notes, "resolve: %s -> %s\n", node->command, node->path);
+        }
+    }
+}
+
+/**
+ * Rewrite a parsed chain in place. Each rewrite is described on notes
+ * unless it is NULL. Returns the number of rewrites.
+ */
+int optimize_chain(command_chain_t *chain, shell_context_t *ctx, FILE *notes) {
+    cmd_node_t **link = &chain->head;
+    int list_start = 1;
+    int rewrites = 0;
+
+    while (*link) {
+        rewrites += fold_stages(chain, link, notes);
+
+        /* Rewrites that can run again on the new *link */
+        if (list_start && (fold_constant(chain, link, notes) ||
+                           merge_builtins(chain, *link, notes))) {
+            rewrites++;
+            continue;
+        }
+
+        /* On to the next pipeline */
+        cmd_node_t *last = pipeline_end(*link);
+        list_start = last->type != CMD_AND && last->type != CMD_OR;
+        link = &last->next;
+    }
+
+    chain->tail = NULL;
+    for (cmd_node_t *node = chain->head; node; node = node->next) {
+        chain->tail = node;
+    }
+
+    hoist_paths(chain, ctx, notes);
+    return rewrites;
+}
+
+/**
+ * Print a word, single-quoted if it would not read back as one word
+ */
+static void plan_word(FILE *out, const char *word) {
+    int plain = *word != '\0';
+
+    for (const char *p = word; *p && plain; p++) {
+        plain = (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                (*p >= '0' && *p <= '9') || strchr("-_./:=,+@%", *p);
+    }
+
+    if (plain) {
+        fputs(word, out);
+        return;
+    }
+
+    fputc('\'', out);
+    for (const char *p = word; *p; p++) {
+        if (*p == '\'') {
+            fputs("'\\''", out);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('\'', out);
+}
+
+/**
+ * Print a chain back as one command line
+ */
+void print_plan(FILE *out, command_chain_t *chain) {
+    for (cmd_node_t *node = chain->head; node; node = node->next) {
+        if (node->timed) {
+            fputs("time ", out);
+        }
+        plan_word(out, node->command ? node->command : "");
+        for (int i = 0; i < node->argc; i++) {
+            fputc(' ', out);
+            plan_word(out, node->args[i]);
+        }
+
+        if (node->input_file) {
+            fputs(" < ", out);
+            plan_word(out, node->input_file);
+        }
+        if (node->input_string) {
+            fputs(" <<< ", out);
+            plan_word(out, node->input_string);
+        }
+        if (node->output_file) {
+            fputs(node->append_output ? " >> " : " > ", out);
+            plan_word(out, node->output_file);
+        }
+
+        if (node->background) {
+            fputs(node->next ? " & " : " &", out);
+        } else if (node->next) {
+            switch (node->type) {
+            case CMD_PIPE:      fputs(" | ", out); break;
+            case CMD_AND:       fputs(" && ", out); break;
+            case CMD_OR:        fputs(" || ", out); break;
+            default:            fputs("; ", out); break;
+            }
+        }
+    }
+    fputc('\n', out);
+}
+
+/**
+ * Built-in explain command: explain 'command line'. Prints the line as
+ * parsed, the optimizer's rewrites and the resulting plan.
+ */
+int builtin_explain(char **args, shell_context_t *ctx) {
+    size_t len = 1;
+
+    if (!args || !args[0]) {
+        fprintf(stderr, "explain: usage: explain 'command line'\n");
+        return 2;
+    }
+
+    for (int i = 0; args[i]; i++) {
+        len += strlen(args[i]) + 1;
+    }
+    char *line = shell_malloc(len);
+    if (!line) {
+        perror("malloc");
+        return 1;
+    }
+    line[0] = '\0';
+    for (int i = 0; args[i]; i++) {
+        if (i > 0) strcat(line, " ");
+        strcat(line, args[i]);
+    }
+
+    command_chain_t *chain = parse_command_line(line);
+    shell_free(line);
+    if (!chain || !chain->head) {
+        free_command_chain(chain);
+        return 1;
+    }
+
+    printf("input: ");
+    print_plan(stdout, chain);
+    optimize_chain(chain, ctx, stdout);
+    printf("plan:  ");
+    print_plan(stdout, chain);
+    if (!ctx->optimize) {
+        printf("(not applied: the optimizer is off, see set -o optimize)\n");
+    }
+
+    free_command_chain(chain);
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "shell.h"
+
+#include <fcntl.h>
+
+/*
+ * Pipeline pipe capacity
+ *
+ * Linux pipes hold 64 KiB by default, so a fast producer blocks (and the
+ * consumer wakes) every 64 KiB. PIPE_SIZE raises the capacity of the
+ * pipes between pipeline stages with F_SETPIPE_SZ:
+ *
+ *     PIPE_SIZE=1m         fixed size (k and m suffixes, bytes if none)
+ *     PIPE_SIZE=max        /proc/sys/fs/pipe-max-size
+ *     PIPE_SIZE=adaptive   grow per command once it looks throughput-bound
+ *
+ * Sizes are capped at pipe-max-size. In adaptive mode each command name
+ * remembers the capacity of the pipe it writes (in its cmd_stats_t
+ * entry). A stage that blocked on its pipe more than once a millisecond
+ * on average over a run of at least PIPE_ADAPT_MIN_NS doubles that
+ * capacity for the next time it writes a pipe.
+ *
+ * The kernel may refuse a size (EPERM once an unprivileged user's pipes
+ * pass fs/pipe-user-pages-soft); the pipe then keeps the size it has.
+ */
+
+#define PIPE_ADAPTIVE -1
+#define PIPE_DEFAULT_SIZE (64 * 1024)       /* Kernel default capacity */
+#define PIPE_FALLBACK_MAX (1024 * 1024)     /* If pipe-max-size can't be read */
+#define PIPE_ADAPT_MIN_NS 10000000LL        /* Shorter stages teach nothing */
+#define PIPE_ADAPT_SWITCH_NS 1000000LL      /* Blocking more often is bound */
+
+/**
+ * Largest capacity an unprivileged process may set, read once
+ */
+static int pipe_max_size(void) {
+    static int max_size;
+
+    if (max_size == 0) {
+        FILE *f = fopen("/proc/sys/fs/pipe-max-size", "r");
+        if (!f || fscanf(f, "%d", &max_size) != 1 || max_size <= 0) {
+            max_size = PIPE_FALLBACK_MAX;
+        }
+        if (f) fclose(f);
+    }
+
+    return max_size;
+}
+
+/**
+ * Parse PIPE_SIZE: a byte count, PIPE_ADAPTIVE, or 0 for the kernel
+ * default (unset, empty or malformed)
+ */
+static long pipe_size_setting(shell_context_t *ctx) {
+    const char *text = var_get(ctx->vars, "PIPE_SIZE");
+    char *end;
+
+    if (!text || !*text) return 0;
+    if (strcmp(text, "adaptive") == 0) return PIPE_ADAPTIVE;
+    if (strcmp(text, "max") == 0) return pipe_max_size();
+
+    long size = strtol(text, &end, 10);
+    if (end == text || size <= 0) return 0;
+
+    if (strcmp(end, "k") == 0 || strcmp(end, "K") == 0) {
+        size *= 1024;
+    } else if (strcmp(end, "m") == 0 || strcmp(end, "M") == 0) {
+        size *= 1024 * 1024;
+    } else if (*end != '\0') {
+        return 0;
+    }
+
+    return size < pipe_max_size() ? size : pipe_max_size();
+}
+
+/**
+ * Size a new pipe written by cmd according to PIPE_SIZE. Returns the
+ * capacity the stage should be judged against in adaptive mode, or 0 if
+ * it is not being tuned.
+ */
+int pipe_tune(shell_context_t *ctx, int write_fd, cmd_node_t *cmd) {
+    long size = pipe_size_setting(ctx);
+
+    if (size == 0) return 0;
+
+    if (size == PIPE_ADAPTIVE) {
+        cmd_stats_t *entry = stats_lookup(&ctx->cmd_stats, cmd->command);
+        if (!entry) return 0;
+        if (entry->pipe_size == 0) {
+            return PIPE_DEFAULT_SIZE; /* Not seen yet: start at the default */
+        }
+        size = entry->pipe_size;
+    }
+
+    int got = fcntl(write_fd, F_SETPIPE_SZ, (int)size);
+    if (got == -1) {
+        got = fcntl(write_fd, F_GETPIPE_SZ);
+    }
+    return got > 0 ? got : 0;
+}
+
+/**
+ * Learn from a reaped stage that wrote a pipe of ps->pipe_size bytes:
+ * grow the command's capacity if the stage was throughput-bound
+ */
+void pipe_observe(shell_context_t *ctx, const proc_stats_t *ps) {
+    if (ps->pipe_size <= 0 || ps->wall_ns < PIPE_ADAPT_MIN_NS) return;
+    if (pipe_size_setting(ctx) != PIPE_ADAPTIVE) return;
+
+    /* Voluntary switches: mostly waits for room in the pipe (or input) */
+    if (ps->nvcsw < ps->wall_ns / PIPE_ADAPT_SWITCH_NS) return;
+
+    cmd_stats_t *entry = stats_lookup(&ctx->cmd_stats, ps->command);
+    if (!entry) return;
+
+    int max_size = pipe_max_size();
+    long grown = (long)ps->pipe_size * 2;
+    entry->pipe_size = grown < max_size ? (int)grown : max_size;
+}
@@ -0,0 +1,367 @@
+#include "shell.h"
+
+#include <ctype.h>
+
+/*
+ * Built-in printf
+ *
+ * POSIX printf: the format's backslash escapes and conversions (%d %i
+ * %o %u %x %X %c %s %b %e %E %f %F %g %G %a %A and %%, with flags, width
+ * and precision, `*` taking either from the arguments) are applied to
+ * the arguments, and the format is reused until every argument has been
+ * consumed. Missing arguments read as "" or 0. A numeric argument that
+ * starts with a quote is the value of the character after it.
+ *
+ * A malformed number is reported, converted as far as it parses, and
+ * makes the exit status 1. `\c` in a %b argument ends all output.
+ */
+
+#define PRINTF_SPEC_MAX 64
+
+typedef struct {
+    char **args;                   /* Remaining arguments */
+    int status;                    /* 1 once a conversion failed */
+    int stop;                      /* \c seen: print nothing more */
+} printf_state_t;
+
+/**
+ * Take the next argument, or "" when they have run out
+ */
+static const char *next_arg(printf_state_t *st) {
+    if (!st->args || !*st->args) return "";
+    return *st->args++;
+}
+
+/**
+ * Report an argument that isn't entirely a number
+ */
+static void bad_number(printf_state_t *st, const char *arg, const char *end) {
+    fflush(stdout);
+    if (end == arg) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+    } else {
+        fprintf(stderr, "printf: %s: not completely converted\n", arg);
+    }
+    st->status = 1;
+}
+
+/**
+ * Next argument as a signed integer
+ */
+static long long arg_signed(printf_state_t *st) {
+    const char *arg = next_arg(st);
+    char *end;
+
+    if (*arg == '\'' || *arg == '"') return (unsigned char)arg[1];
+    if (!*arg) return 0;
+
+    errno = 0;
+    long long value = strtoll(arg, &end, 0);
+    if (*end || errno == ERANGE) bad_number(st, arg, end);
+    return value;
+}
+
+/**
+ * Next argument as an unsigned integer (negative values wrap, as in C)
+ */
+static unsigned long long arg_unsigned(printf_state_t *st) {
+    const char *arg = next_arg(st);
+    char *end;
+
+    if (*arg == '\'' || *arg == '"') return (unsigned char)arg[1];
+    if (!*arg) return 0;
+
+    errno = 0;
+    unsigned long long value = strtoull(arg, &end, 0);
+    if (*end || errno == ERANGE) bad_number(st, arg, end);
+    return value;
+}
+
+/**
+ * Next argument as a floating point number
+ */
+static double arg_double(printf_state_t *st) {
+    const char *arg = next_arg(st);
+    char *end;
+
+    if (*arg == '\'' || *arg == '"') return (unsigned char)arg[1];
+    if (!*arg) return 0;
+
+    errno = 0;
+    double value = strtod(arg, &end);
+    if (*end || errno == ERANGE) bad_number(st, arg, end);
+    return value;
+}
+
+/**
+ * Decode one backslash escape at *p (just after the backslash) and
+ * advance *p past it. In %b arguments octal is written \0ooo and \c
+ * stops output. Returns the byte, or -1 for \c.
+ */
+static int escape(const char **p, int in_arg) {
+    const char *s = *p;
+    int value = 0;
+
+    switch (*s) {
+    case 'a': *p = s + 1; return '\a';
+    case 'b': *p = s + 1; return '\b';
+    case 'f': *p = s + 1; return '\f';
+    case 'n': *p = s + 1; return '\n';
+    case 'r': *p = s + 1; return '\r';
+    case 't': *p = s + 1; return '\t';
+    case 'v': *p = s + 1; return '\v';
+    case '\\': *p = s + 1; return '\\';
+    case 'c':
+        if (in_arg) {
+            *p = s + 1;
+            return -1;
+        }
+        break;
+    case '"': case '\'':
+        if (!in_arg) {
+            *p = s + 1;
+            return *s;
+        }
+        break;
+    }
+
+    if (*s >= '0' && *s <= '7') {
+        int digits = 0;
+        int max = 3;
+        if (in_arg && *s == '0') {
+            s++;   /* \0ooo */
+        }
+        while (digits < max && *s >= '0' && *s <= '7') {
+            value = value * 8 + (*s++ - '0');
+            digits++;
+        }
+        *p = s;
+        return value & 0xff;
+    }
+
+    /* Unknown escape: the backslash stands for itself */
+    return '\\';
+}
+
+/**
+ * Apply one conversion. spec holds "%flags" followed by width and
+ * precision as given; conv is the conversion character.
+ */
+static void convert(printf_state_t *st, char *spec, size_t len, char conv,
+                    int width, int have_width, int precision, int have_precision) {
+    char buf[PRINTF_SPEC_MAX + 8];
+
+    /* Rebuild as %flags*.*<length><conv> and pass width/precision */
+    memcpy(buf, spec, len);
+    buf[len] = '\0';
+    if (have_width) strcat(buf, "*");
+    if (have_precision) strcat(buf, ".*");
+
+    switch (conv) {
+    case 'd': case 'i': {
+        long long v = arg_signed(st);
+        strcat(buf, conv == 'd' ? "lld" : "lli");
+        if (have_width && have_precision) printf(buf, width, precision, v);
+        else if (have_width) printf(buf, width, v);
+        else if (have_precision) printf(buf, precision, v);
+        else printf(buf, v);
+        return;
+    }
+    case 'o': case 'u': case 'x': case 'X': {
+        unsigned long long v = arg_unsigned(st);
+        size_t n = strlen(buf);
+        buf[n] = 'l';
+        buf[n + 1] = 'l';
+        buf[n + 2] = conv;
+        buf[n + 3] = '\0';
+        if (have_width && have_precision) printf(buf, width, precision, v);
+        else if (have_width) printf(buf, width, v);
+        else if (have_precision) printf(buf, precision, v);
+        else printf(buf, v);
+        return;
+    }
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+        double v = arg_double(st);
+        size_t n = strlen(buf);
+        buf[n] = conv;
+        buf[n + 1] = '\0';
+        if (have_width && have_precision) printf(buf, width, precision, v);
+        else if (have_width) printf(buf, width, v);
+        else if (have_precision) printf(buf, precision, v);
+        else printf(buf, v);
+        return;
+    }
+    case 'c': {
+        const char *arg = next_arg(st);
+        strcat(buf, "c");
+        if (have_width) printf(buf, width, *arg);
+        else printf(buf, *arg);
+        return;
+    }
+    case 's': {
+        const char *arg = next_arg(st);
+        strcat(buf, "s");
+        if (have_width && have_precision) printf(buf, width, precision, arg);
+        else if (have_width) printf(buf, width, arg);
+        else if (have_precision) printf(buf, precision, arg);
+        else printf(buf, arg);
+        return;
+    }
+    }
+}
+
+/**
+ * Print a %b argument with width and precision applied to the expanded
+ * text
+ */
+static void convert_b(printf_state_t *st, int left, int width, int have_width,
+                      int precision, int have_precision) {
+    const char *arg = next_arg(st);
+    char *text = shell_malloc(strlen(arg) + 1);
+    size_t n = 0;
+
+    if (!text) {
+        st->status = 1;
+        return;
+    }
+
+    /* Expand into a buffer first, since \0 may appear and \c truncates */
+    for (const char *s = arg; *s; ) {
+        if (*s != '\\' || !s[1]) {
+            text[n++] = *s++;
+            continue;
+        }
+        s++;
+        int c = escape(&s, 1);
+        if (c == -1) {
+            st->stop = 1;
+            break;
+        }
+        text[n++] = (char)c;
+    }
+
+    if (have_precision && (size_t)precision < n) {
+        n = precision;
+    }
+    int pad = have_width && (size_t)width > n ? width - (int)n : 0;
+
+    if (!left) {
+        printf("%*s", pad, "");
+    }
+    fwrite(text, 1, n, stdout);
+    if (left) {
+        printf("%*s", pad, "");
+    }
+    shell_free(text);
+}
+
+/**
+ * Print the format once. Returns the number of conversions that took
+ * an argument.
+ */
+static int print_format(printf_state_t *st, const char *format) {
+    int consumed = 0;
+
+    for (const char *p = format; *p && !st->stop; ) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            putchar(escape(&p, 0));
+            continue;
+        }
+        if (*p != '%') {
+            putchar(*p++);
+            continue;
+        }
+        if (p[1] == '%') {
+            putchar('%');
+            p += 2;
+            continue;
+        }
+
+        /* %[flags][width][.precision]conv */
+        const char *start = p++;
+        while (*p && strchr("-+ #0", *p)) {
+            p++;
+        }
+        size_t flags_len = p - start;
+        int left = memchr(start, '-', flags_len) != NULL;
+
+        int width = 0, have_width = 0;
+        if (*p == '*') {
+            width = (int)arg_signed(st);
+            have_width = 1;
+            consumed++;
+            p++;
+        } else if (isdigit((unsigned char)*p)) {
+            width = (int)strtol(p, (char **)&p, 10);
+            have_width = 1;
+        }
+        if (width < 0) {
+            left = 1;
+        }
+
+        int precision = 0, have_precision = 0;
+        if (*p == '.') {
+            p++;
+            have_precision = 1;
+            if (*p == '*') {
+                precision = (int)arg_signed(st);
+                consumed++;
+                p++;
+            } else {
+                precision = (int)strtol(p, (char **)&p, 10);
+            }
+            if (precision < 0) {
+                have_precision = 0;
+            }
+        }
+
+        char conv = *p;
+        if (!conv || !strchr("diouxXeEfFgGaAcsb", conv) || flags_len > PRINTF_SPEC_MAX) {
+            fflush(stdout);
+            fprintf(stderr, "printf: %.*s: invalid conversion\n",
+                    conv ? (int)(p - start + 1) : (int)(p - start), start);
+            st->status = 1;
+            st->stop = 1;
+            break;
+        }
+        p++;
+        consumed++;
+
+        if (conv == 'b') {
+            convert_b(st, left, width < 0 ? -width : width, have_width,
+                      precision, have_precision);
+        } else {
+            char spec[PRINTF_SPEC_MAX + 1];
+            memcpy(spec, start, flags_len);
+            convert(st, spec, flags_len, conv, width, have_width,
+                    precision, have_precision);
+        }
+    }
+
+    return consumed;
+}
+
+/**
+ * Built-in printf command: printf format [argument...]
+ */
+int builtin_printf(char **args, shell_context_t *ctx) {
+    printf_state_t st = {0};
+
+    (void)ctx;
+
+    if (!args || !args[0]) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    const char *format = args[0];
+    st.args = args + 1;
+
+    /* Reuse the format while arguments remain (at least once) */
+    do {
+        if (print_format(&st, format) == 0) break;
+    } while (!st.stop && *st.args);
+
+    return st.status;
+}
@@ -0,0 +1,287 @@
+#include "shell.h"
+
+/*
+ * Script line profiler
+ *
+ * With MINISHELL_PROFILE=<file> set, the shell attributes wall and CPU
+ * time (its own plus its children's, user and system) to every input line
+ * and to every pipeline run by that line. At exit it writes the samples
+ * in collapsed-stack format ("source:line;pipeline <microseconds>"), which
+ * flamegraph.pl turns into an SVG, and prints the most expensive lines to
+ * stderr. Stacks are weighted by wall time, or by CPU time with
+ * MINISHELL_PROFILE_WEIGHT=cpu.
+ *
+ * Pipeline times come from the per-pipeline measurement in
+ * execute_command_chain(); child CPU is taken from the reaped children's
+ * rusage, so commands launched through the fork server are included.
+ */
+
+#define PROFILE_TOP 20             /* Lines listed in the exit report */
+#define PROFILE_FRAME_MAX 120      /* Bytes of pipeline text kept per frame */
+#define PROFILE_TEXT_SHOWN 48      /* Bytes of line text in the report */
+
+typedef struct {
+    char *frame;                   /* Pipeline text */
+    unsigned long count;           /* Times run */
+    long long wall_ns;
+    long long cpu_us;
+} profile_frame_t;
+
+typedef struct {
+    char *text;                    /* Line as first seen, NULL if never run */
+    unsigned long count;
+    long long wall_ns;
+    long long cpu_us;
+    profile_frame_t *frames;       /* Pipelines run by this line */
+    int frame_count;
+    int frame_capacity;
+} profile_line_t;
+
+int profile_enabled = 0;
+
+static profile_line_t *profile_lines;    /* Indexed by line number */
+static int profile_capacity;
+static char *profile_path;
+static char *profile_source;
+static pid_t profile_owner;
+static int profile_weight_cpu;           /* Weight stacks by CPU, not wall */
+
+/* Line being run, or 0 */
+static int current_line;
+static long long line_start_ns;
+static long long line_child_cpu_us;
+static struct rusage line_self0;
+
+/**
+ * Microseconds of user plus system time in a rusage
+ */
+static long long rusage_cpu_us(const struct rusage *ru) {
+    return (long long)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000LL +
+           ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+}
+
+/**
+ * Entry for a line number, growing the table as needed
+ */
+static profile_line_t *profile_line(int lineno) {
+    if (lineno >= profile_capacity) {
+        int capacity = profile_capacity ? profile_capacity : 64;
+        while (capacity <= lineno) {
+            capacity *= 2;
+        }
+
+        profile_line_t *lines = realloc(profile_lines, capacity * sizeof(profile_line_t));
+        if (!lines) {
+            perror("realloc");
+            return NULL;
+        }
+        memset(lines + profile_capacity, 0,
+               (capacity - profile_capacity) * sizeof(profile_line_t));
+        profile_lines = lines;
+        profile_capacity = capacity;
+    }
+
+    return &profile_lines[lineno];
+}
+
+/**
+ * Start timing an input line
+ */
+void profile_line_begin(int lineno, const char *text) {
+    profile_line_t *line = profile_line(lineno);
+    if (!line) return;
+
+    if (!line->text) {
+        line->text = shell_strdup(text);
+    }
+
+    current_line = lineno;
+    line_child_cpu_us = 0;
+    getrusage(RUSAGE_SELF, &line_self0);
+    line_start_ns = trace_now();
+}
+
+/**
+ * Finish timing the current input line
+ */
+void profile_line_end(void) {
+    if (!current_line) return;
+
+    struct rusage self1;
+    long long wall = trace_now() - line_start_ns;
+    profile_line_t *line = &profile_lines[current_line];
+
+    getrusage(RUSAGE_SELF, &self1);
+    line->count++;
+    line->wall_ns += wall;
+    line->cpu_us += rusage_cpu_us(&self1) - rusage_cpu_us(&line_self0) + line_child_cpu_us;
+    current_line = 0;
+}
+
+/**
+ * Text of a pipeline for its frame: "cmd args | cmd args". Semicolons
+ * separate frames in collapsed stacks, so they are replaced.
+ */
+static void pipeline_frame(cmd_node_t *first, int stages, char *buf, size_t size) {
+    size_t len = 0;
+    cmd_node_t *cmd = first;
+
+    buf[0] = '\0';
+    for (int i = 0; i < stages && cmd && len < size - 1; i++, cmd = cmd->next) {
+        len += snprintf(buf + len, size - len, "%s%s", i ? " | " : "",
+                        cmd->command ? cmd->command : "");
+        for (int a = 0; a < cmd->argc && len < size - 1; a++) {
+            len += snprintf(buf + len, size - len, " %s", cmd->args[a]);
+        }
+    }
+
+    for (char *p = buf; *p; p++) {
+        if (*p == ';' || *p == '\n') *p = ':';
+    }
+}
+
+/**
+ * Record one pipeline of the current line: its wall time, the shell's
+ * own CPU time while it ran and its children's CPU time
+ */
+void profile_pipeline(cmd_node_t *first, int stages, long long wall_ns,
+                      long long self_cpu_us, long long child_cpu_us) {
+    if (!current_line) return;
+
+    profile_line_t *line = &profile_lines[current_line];
+    char frame[PROFILE_FRAME_MAX];
+    pipeline_frame(first, stages, frame, sizeof(frame));
+
+    line_child_cpu_us += child_cpu_us;
+
+    profile_frame_t *f = NULL;
+    for (int i = 0; i < line->frame_count; i++) {
+        if (strcmp(line->frames[i].frame, frame) == 0) {
+            f = &line->frames[i];
+            break;
+        }
+    }
+
+    if (!f) {
+        if (line->frame_count == line->frame_capacity) {
+            int capacity = line->frame_capacity ? line->frame_capacity * 2 : 4;
+            profile_frame_t *frames = realloc(line->frames, capacity * sizeof(profile_frame_t));
+            if (!frames) {
+                perror("realloc");
+                return;
+            }
+            line->frames = frames;
+            line->frame_capacity = capacity;
+        }
+
+        f = &line->frames[line->frame_count];
+        memset(f, 0, sizeof(*f));
+        if (!(f->frame = shell_strdup(frame))) return;
+        line->frame_count++;
+    }
+
+    f->count++;
+    f->wall_ns += wall_ns;
+    f->cpu_us += self_cpu_us + child_cpu_us;
+}
+
+/**
+ * Compare line numbers by wall time, most expensive first
+ */
+static int profile_cmp(const void *a, const void *b) {
+    long long x = profile_lines[*(const int *)a].wall_ns;
+    long long y = profile_lines[*(const int *)b].wall_ns;
+    return (x < y) - (x > y);
+}
+
+/**
+ * Print the most expensive lines to stderr
+ */
+static void profile_report(void) {
+    int *order = malloc(profile_capacity * sizeof(int));
+    int n = 0;
+
+    if (!order) return;
+    for (int i = 1; i < profile_capacity; i++) {
+        if (profile_lines[i].count) order[n++] = i;
+    }
+    qsort(order, n, sizeof(int), profile_cmp);
+
+    fprintf(stderr, "\nprofile: %s, top %d lines by wall time\n",
+            profile_source, n < PROFILE_TOP ? n : PROFILE_TOP);
+    fprintf(stderr, "%6s %7s %11s %11s  %s\n", "line", "runs", "wall_ms", "cpu_ms", "command");
+    for (int i = 0; i < n && i < PROFILE_TOP; i++) {
+        profile_line_t *line = &profile_lines[order[i]];
+        fprintf(stderr, "%6d %7lu %11.3f %11.3f  %.*s\n", order[i], line->count,
+                line->wall_ns / 1e6, line->cpu_us / 1e3,
+                PROFILE_TEXT_SHOWN, line->text ? line->text : "");
+    }
+
+    free(order);
+}
+
+/**
+ * Write collapsed stacks and the report. Runs at exit.
+ */
+static void profile_flush(void) {
+    if (!profile_enabled || getpid() != profile_owner) return;
+
+    /* The 'exit' builtin leaves its own line open */
+    profile_line_end();
+
+    FILE *out = fopen(profile_path, "w");
+    if (!out) {
+        perror(profile_path);
+        return;
+    }
+
+    for (int i = 1; i < profile_capacity; i++) {
+        profile_line_t *line = &profile_lines[i];
+        long long inner_us = 0;
+
+        if (!line->count) continue;
+
+        for (int f = 0; f < line->frame_count; f++) {
+            profile_frame_t *frame = &line->frames[f];
+            long long us = profile_weight_cpu ? frame->cpu_us : frame->wall_ns / 1000;
+            fprintf(out, "%s:%d;%s %lld\n", profile_source, i, frame->frame, us);
+            inner_us += us;
+        }
+
+        /* Parsing and bookkeeping outside any pipeline */
+        long long total_us = profile_weight_cpu ? line->cpu_us : line->wall_ns / 1000;
+        if (total_us > inner_us) {
+            fprintf(out, "%s:%d %lld\n", profile_source, i, total_us - inner_us);
+        }
+    }
+    fclose(out);
+
+    profile_report();
+    profile_enabled = 0;
+}
+
+/**
+ * Enable profiling. source names the input ("script.sh", "stdin", ...)
+ * in stack frames; the profile is written to path at exit.
+ */
+void profile_init(const char *path, const char *source, int weight_cpu) {
+    profile_path = shell_strdup(path);
+    profile_source = shell_strdup(source);
+    if (!profile_path || !profile_source) {
+        shell_free(profile_path);
+        shell_free(profile_source);
+        profile_path = NULL;
+        profile_source = NULL;
+        return;
+    }
+
+    /* Stack frames are separated by semicolons */
+    for (char *p = profile_source; *p; p++) {
+        if (*p == ';') *p = ':';
+    }
+
+    profile_owner = getpid();
+    profile_weight_cpu = weight_cpu;
+    profile_enabled = 1;
+    atexit(profile_flush);
+}
@@ -0,0 +1,244 @@
+#include "shell.h"
+
+#include <stdint.h>
+
+/*
+ * Session record and replay
+ *
+ * With MINISHELL_RECORD=<file> set, every input line the shell runs is
+ * appended to a binary log together with the idle time before it, how
+ * long it took and its exit status. `minishell --replay <file>` feeds
+ * the lines back through the normal line runner (parse_command_line()
+ * and execute_command_chain()), waiting out the recorded idle time
+ * divided by --speed (0 means no waiting), and reports exit statuses and
+ * timings that differ from the recording.
+ *
+ * Log format: the 8-byte magic "MSHREC01", then one record per line of
+ * four unsigned LEB128 varints and the line bytes:
+ *
+ *     idle_ns  duration_ns  exit_status  length  line[length]
+ */
+
+#define RECORD_MAGIC "MSHREC01"
+#define RECORD_MAGIC_LEN 8
+#define REPLAY_TOP 10              /* Timing differences listed */
+
+int record_enabled = 0;
+
+static FILE *record_out;
+static pid_t record_owner;
+static long long record_last_end;  /* End of the previous recorded line */
+
+/**
+ * Write an unsigned LEB128 varint
+ */
+static void put_varint(FILE *out, uint64_t v) {
+    while (v >= 0x80) {
+        fputc((int)(v & 0x7f) | 0x80, out);
+        v >>= 7;
+    }
+    fputc((int)v, out);
+}
+
+/**
+ * Read an unsigned LEB128 varint. Returns -1 at end of file or on a
+ * malformed value.
+ */
+static int get_varint(FILE *in, uint64_t *v) {
+    *v = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(in);
+        if (c == EOF) return -1;
+
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Flush the log (in the shell itself, not its children)
+ */
+static void record_close(void) {
+    if (record_out && getpid() == record_owner) {
+        fclose(record_out);
+        record_out = NULL;
+        record_enabled = 0;
+    }
+}
+
+/**
+ * Start recording input lines to a log file
+ */
+void record_init(const char *path) {
+    record_out = fopen(path, "wbe");
+    if (!record_out) {
+        perror(path);
+        return;
+    }
+
+    fwrite(RECORD_MAGIC, 1, RECORD_MAGIC_LEN, record_out);
+    record_owner = getpid();
+    record_last_end = trace_now();
+    record_enabled = 1;
+    atexit(record_close);
+}
+
+/**
+ * Append one line to the log. start_ns and duration_ns are trace_now()
+ * based; status is the line's exit status.
+ */
+void record_line(const char *line, long long start_ns, long long duration_ns, int status) {
+    size_t len = strlen(line);
+    long long idle = start_ns - record_last_end;
+
+    put_varint(record_out, idle > 0 ? (uint64_t)idle : 0);
+    put_varint(record_out, duration_ns > 0 ? (uint64_t)duration_ns : 0);
+    put_varint(record_out, (uint64_t)(status & 0xff));
+    put_varint(record_out, len);
+    fwrite(line, 1, len, record_out);
+
+    record_last_end = start_ns + duration_ns;
+}
+
+typedef struct {
+    int lineno;
+    long long recorded_ns;
+    long long replayed_ns;
+} replay_diff_t;
+
+/**
+ * Order timing differences by size, largest first
+ */
+static int replay_diff_cmp(const void *a, const void *b) {
+    const replay_diff_t *x = a, *y = b;
+    long long dx = llabs(x->replayed_ns - x->recorded_ns);
+    long long dy = llabs(y->replayed_ns - y->recorded_ns);
+    return (dx < dy) - (dx > dy);
+}
+
+/**
+ * Sleep for a number of nanoseconds
+ */
+static void replay_sleep(long long ns) {
+    struct timespec ts = {ns / 1000000000LL, ns % 1000000000LL};
+
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+        /* Keep sleeping for the remainder */
+    }
+}
+
+/**
+ * Replay a recorded session through run. speed scales idle time (2 runs
+ * twice as fast, 0 doesn't wait). Returns the number of lines whose exit
+ * status differed, or -1 if the log could not be opened or is malformed.
+ */
+int replay_session(const char *path, double speed, shell_context_t *ctx,
+                   void (*run)(const char *line, shell_context_t *ctx)) {
+    FILE *in = fopen(path, "rbe");
+    char magic[RECORD_MAGIC_LEN];
+
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    if (fread(magic, 1, RECORD_MAGIC_LEN, in) != RECORD_MAGIC_LEN ||
+        memcmp(magic, RECORD_MAGIC, RECORD_MAGIC_LEN) != 0) {
+        fprintf(stderr, "minishell: %s: not a session log\n", path);
+        fclose(in);
+        return -1;
+    }
+
+    replay_diff_t *diffs = NULL;
+    int count = 0, capacity = 0, mismatches = 0, result = 0;
+    long long recorded_total = 0, replayed_total = 0;
+    char *line = NULL;
+
+    for (;;) {
+        uint64_t idle, duration, status, len;
+
+        if (get_varint(in, &idle) == -1) break; /* End of log */
+        if (get_varint(in, &duration) == -1 || get_varint(in, &status) == -1 ||
+            get_varint(in, &len) == -1 || len >= MAX_COMMAND_LENGTH * 64) {
+            fprintf(stderr, "minishell: %s: truncated record\n", path);
+            result = -1;
+            break;
+        }
+
+        char *buf = realloc(line, len + 1);
+        if (!buf) {
+            perror("realloc");
+            result = -1;
+            break;
+        }
+        line = buf;
+        if (fread(line, 1, len, in) != len) {
+            fprintf(stderr, "minishell: %s: truncated record\n", path);
+            result = -1;
+            break;
+        }
+        line[len] = '\0';
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            replay_diff_t *d = realloc(diffs, capacity * sizeof(replay_diff_t));
+            if (!d) {
+                perror("realloc");
+                result = -1;
+                break;
+            }
+            diffs = d;
+        }
+
+        if (speed > 0) {
+            replay_sleep((long long)(idle / speed));
+        }
+
+        ctx->lineno = count + 1;
+        long long start = trace_now();
+        run(line, ctx);
+        long long elapsed = trace_now() - start;
+
+        if ((uint64_t)ctx->last_exit_status != status) {
+            fflush(stdout);
+            fprintf(stderr, "replay: line %d: exit %d, recorded %d: %s\n",
+                    count + 1, ctx->last_exit_status, (int)status, line);
+            mismatches++;
+        }
+
+        diffs[count].lineno = count + 1;
+        diffs[count].recorded_ns = (long long)duration;
+        diffs[count].replayed_ns = elapsed;
+        recorded_total += (long long)duration;
+        replayed_total += elapsed;
+        count++;
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "replay: %d lines, %d exit status differences\n", count, mismatches);
+    fprintf(stderr, "replay: busy time %.3fs recorded, %.3fs replayed",
+            recorded_total / 1e9, replayed_total / 1e9);
+    if (recorded_total > 0) {
+        fprintf(stderr, " (%.2fx)", (double)replayed_total / recorded_total);
+    }
+    fprintf(stderr, "\n");
+
+    if (count > 0) {
+        qsort(diffs, count, sizeof(replay_diff_t), replay_diff_cmp);
+        fprintf(stderr, "%6s %12s %12s %10s\n", "line", "recorded_ms", "replayed_ms", "change");
+        for (int i = 0; i < count && i < REPLAY_TOP; i++) {
+            replay_diff_t *d = &diffs[i];
+            fprintf(stderr, "%6d %12.3f %12.3f %+9.1f%%\n", d->lineno,
+                    d->recorded_ns / 1e6, d->replayed_ns / 1e6,
+                    d->recorded_ns > 0
+                        ? 100.0 * (d->replayed_ns - d->recorded_ns) / d->recorded_ns : 0.0);
+        }
+    }
+
+    free(diffs);
+    free(line);
+    fclose(in);
+    return result < 0 ? result : mismatches;
+}
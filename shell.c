@@ -4,29 +4,76 @@
  * Initialize shell context
  */
 shell_context_t* init_shell_context(void) {
-    shell_context_t *ctx = malloc(sizeof(shell_context_t));
+    shell_context_t *ctx = shell_malloc(sizeof(shell_context_t));
     if (!ctx) {
         perror("malloc");
         return NULL;
     }
     
-    ctx->environ = environ;
+    ctx->vars = var_store_create(environ);
+    if (!ctx->vars) {
+        shell_free(ctx);
+        return NULL;
+    }
     ctx->last_exit_status = 0;
+    ctx->exec_tail = 0;
+    ctx->interactive = 0;
+    ctx->noexec = 0;
+    ctx->forkserver_fd = -1;
+    ctx->forkserver_pid = -1;
+    ctx->proc_stats = NULL;
+    ctx->proc_count = 0;
+    ctx->proc_capacity = 0;
+    ctx->cmd_stats.entries = NULL;
+    ctx->cmd_stats.capacity = 0;
+    ctx->cmd_stats.count = 0;
+    ctx->lineno = 0;
+    ctx->xtrace = 0;
+    ctx->optimize = 0;
+    ctx->epoll_fd = -1;
+    ctx->signal_fd = -1;
+    ctx->interrupted = 0;
+    memset(&ctx->jobs, 0, sizeof(ctx->jobs));
+    ctx->job_control = 0;
+    ctx->shell_pgid = 0;
+    ctx->fg_pgid = 0;
+    ctx->fg_stopped = 0;
+    ctx->timeout_ns = 0;
+    ctx->timeout_grace_ns = 0;
     
-    if (getcwd(ctx->current_dir, sizeof(ctx->current_dir)) == NULL) {
-        perror("getcwd");
-        strcpy(ctx->current_dir, "/");
-    }
+    /* Resolved on first use; most -c runs never ask for it */
+    ctx->current_dir[0] = '\0';
     
     return ctx;
 }
 
+/**
+ * Get the current working directory, resolving it on first use.
+ * Returns NULL with errno set if it can't be determined; nothing is
+ * cached then, so the next call tries again.
+ */
+const char* get_current_dir(shell_context_t *ctx) {
+    if (ctx->current_dir[0] == '\0' &&
+        getcwd(ctx->current_dir, sizeof(ctx->current_dir)) == NULL) {
+        ctx->current_dir[0] = '\0';
+        return NULL;
+    }
+    
+    return ctx->current_dir;
+}
+
 /**
  * Cleanup shell context
  */
 void cleanup_shell_context(shell_context_t *ctx) {
     if (ctx) {
-        free(ctx);
+        forkserver_stop(ctx);
+        var_store_free(ctx->vars);
+        free(ctx->proc_stats);
+        stats_free(&ctx->cmd_stats);
+        jobs_free(ctx);
+        event_loop_free(ctx);
+        shell_free(ctx);
     }
 }
 
@@ -39,19 +86,9 @@ void print_prompt(void) {
 }
 
 /**
- * Signal handler for SIGINT (Ctrl+C)
- */
-void sigint_handler(int sig) {
-    (void)sig; /* Suppress unused parameter warning */
-    printf("\n");
-    print_prompt();
-}
-
-/**
- * Setup signal handlers
+ * Setup signal handlers. SIGINT is read from the event loop's signalfd.
  */
 void handle_signals(void) {
-    signal(SIGINT, sigint_handler);
     signal(SIGQUIT, SIG_IGN);
 }
 
@@ -98,6 +135,13 @@ char* parse_token(const char **input, int *is_operator) {
         return shell_strdup("&&");
     }
     
+    if (*current == '&') {
+        /* & operator (background) */
+        *is_operator = 1;
+        *input = current + 1;
+        return shell_strdup("&");
+    }
+    
     if (*current == ';') {
         /* ; operator */
         *is_operator = 1;
@@ -105,6 +149,27 @@ char* parse_token(const char **input, int *is_operator) {
         return shell_strdup(";");
     }
     
+    if (*current == '<' && *(current + 1) == '<' && *(current + 2) == '<') {
+        /* <<< here-string */
+        *is_operator = 1;
+        *input = current + 3;
+        return shell_strdup("<<<");
+    }
+    
+    if (*current == '>' && *(current + 1) == '>') {
+        /* >> redirection (append) */
+        *is_operator = 1;
+        *input = current + 2;
+        return shell_strdup(">>");
+    }
+    
+    if (*current == '>' || *current == '<') {
+        /* > or < redirection */
+        *is_operator = 1;
+        *input = current + 1;
+        return shell_strdup(*current == '>' ? ">" : "<");
+    }
+    
     start = current;
     
     /* Handle quoted strings */
@@ -125,7 +190,7 @@ char* parse_token(const char **input, int *is_operator) {
         if (*current == quote_char) {
             /* Found closing quote */
             int len = current - start;
-            char *token = malloc(len + 1);
+            char *token = shell_malloc(len + 1);
             if (!token) {
                 perror("malloc");
                 return NULL;
@@ -144,7 +209,8 @@ char* parse_token(const char **input, int *is_operator) {
     /* Handle regular tokens - stop at operators */
     start = current;
     while (*current && *current != ' ' && *current != '\t' && *current != '\n' &&
-           *current != '|' && *current != '&' && *current != ';') {
+           *current != '|' && *current != '&' && *current != ';' &&
+           *current != '<' && *current != '>') {
         current++;
     }
     
@@ -154,7 +220,7 @@ char* parse_token(const char **input, int *is_operator) {
     }
     
     int len = current - start;
-    char *token = malloc(len + 1);
+    char *token = shell_malloc(len + 1);
     if (!token) {
         perror("malloc");
         return NULL;
@@ -166,6 +232,42 @@ char* parse_token(const char **input, int *is_operator) {
     return token;
 }
 
+/**
+ * If op is a redirection operator, read its file name (or here-string
+ * word) from input into node; a later redirection of the same stream
+ * wins. Returns 1 if op was consumed, 0 if it is a command separator.
+ */
+static int parse_redirection(cmd_node_t *node, char *op, const char **input) {
+    int is_operator;
+    char **target;
+    
+    if (strcmp(op, "<") == 0 || strcmp(op, "<<<") == 0) {
+        /* Only one source for stdin: the later one */
+        target = op[1] ? &node->input_string : &node->input_file;
+        shell_free(op[1] ? node->input_file : node->input_string);
+        node->input_file = node->input_string = NULL;
+    } else if (strcmp(op, ">") == 0 || strcmp(op, ">>") == 0) {
+        target = &node->output_file;
+        node->append_output = op[1] == '>';
+    } else {
+        return 0;
+    }
+    shell_free(op);
+    
+    const char *before = *input;
+    char *file = parse_token(input, &is_operator);
+    if (!file || is_operator) {
+        fprintf(stderr, "minishell: syntax error: missing file name after redirection\n");
+        shell_free(file);
+        *input = before;
+        return 1;
+    }
+    
+    shell_free(*target);
+    *target = file;
+    return 1;
+}
+
 /**
  * Parse a single command (until operator or end)
  */
@@ -174,40 +276,64 @@ cmd_node_t* parse_single_command(const char **input) {
     char *token = parse_token(input, &is_operator);
     
     if (!token || is_operator) {
-        free(token);
+        shell_free(token);
         return NULL;
     }
     
     cmd_node_t *node = create_cmd_node();
     if (!node) {
-        free(token);
+        shell_free(token);
         return NULL;
     }
     
+    /* 'time' keyword: report resource usage of the pipeline it prefixes */
+    if (strcmp(token, "time") == 0) {
+        const char *before = *input;
+        char *word = parse_token(input, &is_operator);
+        
+        if (word && !is_operator) {
+            shell_free(token);
+            token = word;
+            node->timed = 1;
+        } else {
+            shell_free(word);
+            *input = before;
+        }
+    }
+    
     node->command = token;
+    node->builtin_id = lookup_builtin(token);
     
     /* Collect arguments until we hit an operator */
     char *args[MAX_ARGS];
     int argc = 0;
     
-    while ((token = parse_token(input, &is_operator)) && !is_operator && argc < MAX_ARGS - 1) {
+    while (argc < MAX_ARGS - 1) {
+        const char *before = *input;
+        token = parse_token(input, &is_operator);
+        if (!token) break;
+        
+        if (is_operator && parse_redirection(node, token, input)) {
+            continue;
+        }
+        
+        if (is_operator) {
+            /* Put the operator back for parse_command_line() to classify */
+            shell_free(token);
+            *input = before;
+            break;
+        }
+        
         args[argc++] = token;
     }
     
-    /* If we got an operator, put it back by backing up the input pointer */
-    if (token && is_operator) {
-        /* We need to back up - this is a limitation of our simple parser */
-        /* For now, we'll handle this in the main parsing loop */
-        free(token);
-    }
-    
     if (argc > 0) {
-        node->args = malloc((argc + 1) * sizeof(char*));
+        node->args = shell_malloc((argc + 1) * sizeof(char*));
         if (!node->args) {
             perror("malloc");
             /* Clean up collected arguments */
             for (int i = 0; i < argc; i++) {
-                free(args[i]);
+                shell_free(args[i]);
             }
             free_cmd_node(node);
             return NULL;
@@ -267,6 +393,11 @@ command_chain_t* parse_command_line(const char *line) {
                 /* ; operator */
                 node->type = CMD_SEMICOLON;
                 current++; /* Skip ; */
+            } else if (*current == '&') {
+                /* & operator: run in the background, then carry on as with ; */
+                node->background = 1;
+                node->type = CMD_SEMICOLON;
+                current++; /* Skip & */
             }
         }
         
@@ -277,17 +408,250 @@ command_chain_t* parse_command_line(const char *line) {
     return chain;
 }
 
+/*
+ * Everything below drives the interactive/script loop. Building with
+ * -DMINISHELL_NO_MAIN leaves just the parser and context code, so other
+ * programs (bench/parsebench.c) can link it.
+ */
+#ifndef MINISHELL_NO_MAIN
+
+/**
+ * Parse and execute one line of input
+ */
+static void run_line(const char *line, shell_context_t *ctx) {
+    long long start = TRACE_ON() ? trace_now() : 0;
+    
+    mem_line_mark();
+    reap_background_jobs(ctx);
+    if (PROFILE_ON()) {
+        profile_line_begin(ctx->lineno, line);
+    }
+    if (RECORD_ON()) {
+        /* The line must finish here to be logged */
+        ctx->exec_tail = 0;
+        start = trace_now();
+    }
+    
+    command_chain_t *chain = parse_command_line(line);
+    
+    if (TRACE_ON()) {
+        trace_record("parse", line, start, trace_now() - start, 0);
+    }
+    
+    if (chain) {
+        if (!ctx->noexec) {
+            execute_command_chain(chain, ctx);
+        }
+        free_command_chain(chain);
+    }
+    
+    /* Report finished and stopped jobs before the next prompt */
+    jobs_notify(ctx);
+    
+    if (PROFILE_ON()) {
+        profile_line_end();
+    }
+    if (RECORD_ON()) {
+        record_line(line, start, trace_now() - start, ctx->last_exit_status);
+    }
+}
+
+/**
+ * Read one line from a stream, stripping the trailing newline.
+ * Returns -1 at end of input.
+ */
+static ssize_t read_line(char **line, size_t *len, FILE *in) {
+    /* Don't hold trace lines back while we wait for input */
+    xtrace_flush();
+    
+    ssize_t read = getline(line, len, in);
+    
+    /* Remove trailing newline */
+    if (read > 0 && (*line)[read - 1] == '\n') {
+        (*line)[--read] = '\0';
+    }
+    
+    return read;
+}
+
+/**
+ * Prompt for and read one line from the terminal, through the event loop
+ * when it is available
+ */
+static ssize_t read_interactive_line(shell_context_t *ctx, char **line, size_t *len) {
+    if (ctx->epoll_fd < 0) {
+        print_prompt();
+        return read_line(line, len, stdin);
+    }
+    
+    /* Don't hold trace lines back while we wait for input */
+    xtrace_flush();
+    return event_read_line(ctx, line, len);
+}
+
+/**
+ * Run commands from a non-interactive stream (script file or pipe).
+ * Reads one line ahead so the last line can be run in tail position.
+ */
+static void run_script(FILE *in, shell_context_t *ctx) {
+    char *line = NULL, *next = NULL;
+    size_t len = 0, next_len = 0;
+    ssize_t read = read_line(&line, &len, in);
+    
+    while (read != -1) {
+        ssize_t next_read = read_line(&next, &next_len, in);
+        
+        ctx->lineno++;
+        ctx->exec_tail = (next_read == -1);
+        if (read > 0) {
+            run_line(line, ctx);
+        }
+        
+        /* Swap buffers so the lookahead becomes the current line */
+        char *tmp = line;
+        size_t tmp_len = len;
+        line = next;
+        len = next_len;
+        next = tmp;
+        next_len = tmp_len;
+        read = next_read;
+    }
+    
+    free(line);
+    free(next);
+}
+
 /**
  * Main shell loop
  */
-int main(void) {
+int main(int argc, char **argv) {
     shell_context_t *ctx = init_shell_context();
     if (!ctx) {
         fprintf(stderr, "Failed to initialize shell\n");
         return 1;
     }
     
+    const char *trace_path = getenv("MINISHELL_TRACE");
+    if (trace_path && *trace_path) {
+        trace_init(trace_path);
+    }
+    
+    const char *metrics_path = getenv("MINISHELL_METRICS_SOCKET");
+    if (metrics_path && *metrics_path) {
+        metrics_start(metrics_path);
+    }
+    
+    /* Fork the launcher while our heap is still small */
+    if (getenv("MINISHELL_FORKSERVER")) {
+        forkserver_start(ctx);
+    }
+    
+    /* Options: -n (parse only), -c 'command', --replay log, --speed N, -- */
+    const char *command = NULL;
+    const char *replay = NULL;
+    double speed = 1.0;
+    int argi = 1;
+    
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (strcmp(argv[argi], "-n") == 0) {
+            ctx->noexec = 1;
+        } else if (strcmp(argv[argi], "-c") == 0) {
+            if (++argi >= argc) {
+                fprintf(stderr, "minishell: -c: option requires an argument\n");
+                cleanup_shell_context(ctx);
+                return 2;
+            }
+            command = argv[argi++];
+            break;
+        } else if (strcmp(argv[argi], "--replay") == 0 ||
+                   strcmp(argv[argi], "--speed") == 0) {
+            if (argi + 1 >= argc) {
+                fprintf(stderr, "minishell: %s: option requires an argument\n", argv[argi]);
+                cleanup_shell_context(ctx);
+                return 2;
+            }
+            if (argv[argi][2] == 'r') {
+                replay = argv[++argi];
+            } else {
+                speed = atof(argv[++argi]);
+            }
+        } else if (strcmp(argv[argi], "--") == 0) {
+            argi++;
+            break;
+        } else {
+            fprintf(stderr, "minishell: %s: invalid option\n", argv[argi]);
+            cleanup_shell_context(ctx);
+            return 2;
+        }
+    }
+    
+    const char *profile_path = getenv("MINISHELL_PROFILE");
+    if (profile_path && *profile_path) {
+        const char *weight = getenv("MINISHELL_PROFILE_WEIGHT");
+        profile_init(profile_path, command ? "-c" : argi < argc ? argv[argi] : "stdin",
+                     weight && strcmp(weight, "cpu") == 0);
+    }
+    
+    const char *record_path = getenv("MINISHELL_RECORD");
+    if (record_path && *record_path) {
+        record_init(record_path);
+    }
+    
+    /* Interactive: no command or script, and a terminal on stdin */
+    ctx->interactive = !replay && !command && argi >= argc && isatty(STDIN_FILENO);
+    if (ctx->interactive) {
+        event_loop_init(ctx);
+    }
+    
+    /* minishell --replay log [--speed N] */
+    if (replay) {
+        /* 2: unreadable log, 1: exit statuses differed */
+        int result = replay_session(replay, speed, ctx, run_line);
+        
+        int status = result < 0 ? 2 : result > 0;
+        cleanup_shell_context(ctx);
+        return status;
+    }
+    
+    /* minishell -c 'command' */
+    if (command) {
+        ctx->lineno = 1;
+        ctx->exec_tail = 1;
+        run_line(command, ctx);
+        
+        int status = ctx->last_exit_status;
+        cleanup_shell_context(ctx);
+        return status;
+    }
+    
+    /* minishell script */
+    if (argi < argc) {
+        FILE *script = fopen(argv[argi], "re"); /* Not inherited by children */
+        if (!script) {
+            perror(argv[argi]);
+            cleanup_shell_context(ctx);
+            return 127;
+        }
+        run_script(script, ctx);
+        fclose(script);
+        
+        int status = ctx->last_exit_status;
+        cleanup_shell_context(ctx);
+        return status;
+    }
+    
+    /* Commands piped in on stdin: same as a script, no prompt or banner */
+    if (!isatty(STDIN_FILENO)) {
+        run_script(stdin, ctx);
+        
+        int status = ctx->last_exit_status;
+        cleanup_shell_context(ctx);
+        return status;
+    }
+    
+    /* Interactive-only setup from here on */
     handle_signals();
+    jobs_init(ctx);
     
     printf("Mini Shell v1.0 - POSIX Compatible\n");
     printf("Type 'exit' to quit\n\n");
@@ -297,11 +661,9 @@ int main(void) {
     ssize_t read;
     
     while (1) {
-        print_prompt();
-        
-        read = getline(&line, &len, stdin);
+        read = read_interactive_line(ctx, &line, &len);
         if (read == -1) {
-            if (feof(stdin)) {
+            if (ctx->epoll_fd >= 0 || feof(stdin)) {
                 printf("\n");
                 break;
             }
@@ -309,25 +671,21 @@ int main(void) {
             continue;
         }
         
-        /* Remove trailing newline */
-        if (read > 0 && line[read - 1] == '\n') {
-            line[read - 1] = '\0';
-        }
+        ctx->lineno++;
         
         /* Skip empty lines */
-        if (strlen(line) == 0) {
+        if (read == 0) {
             continue;
         }
         
         /* Parse and execute command */
-        command_chain_t *chain = parse_command_line(line);
-        if (chain) {
-            execute_command_chain(chain, ctx);
-            free_command_chain(chain);
-        }
+        run_line(line, ctx);
     }
     
     free(line);
+    int status = ctx->last_exit_status;
     cleanup_shell_context(ctx);
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
+
+#endif /* MINISHELL_NO_MAIN */
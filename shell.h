@@ -12,10 +12,16 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <termios.h>
 
 #define MAX_COMMAND_LENGTH 1024
 #define MAX_ARGS 64
 #define MAX_PATH 256
+#define EXIT_TIMEOUT 124           /* Status of a command past its deadline */
+#define EXIT_INTERRUPTED 130       /* Status of a builtin stopped by Ctrl-C */
 
 /* External environment variable declaration */
 extern char **environ;
@@ -26,7 +32,7 @@ typedef enum {
     CMD_AND,        /* Command with && */
     CMD_OR,         /* Command with || */
     CMD_PIPE,       /* Command with | */
-    // CMD_SEMICOLON   /* Command with ; */
+    CMD_SEMICOLON   /* Command with ; */
 } cmd_type_t;
 
 /* Command node structure for chained list */
@@ -39,9 +45,13 @@ typedef struct cmd_node {
     
     /* Redirection information */
     char *input_file;              /* Input redirection file */
+    char *input_string;            /* Here-string (<<< word), read with a newline */
     char *output_file;             /* Output redirection file */
     int append_output;             /* Append output flag */
     int background;                /* Background execution flag */
+    int builtin_id;                /* Builtin table index, or BUILTIN_* */
+    int timed;                     /* Pipeline prefixed with 'time' */
+    char *path;                    /* Resolved executable, NULL until needed */
 } cmd_node_t;
 
 /* Command chain structure */
@@ -51,13 +61,179 @@ typedef struct {
     int count;                     /* Number of commands */
 } command_chain_t;
 
+/* Resource usage of one reaped child */
+typedef struct {
+    const char *command;           /* Command name (owned by the node) */
+    pid_t pid;                     /* Child process id */
+    int status;                    /* Raw wait status */
+    struct timespec start;         /* When the child was forked */
+    long long launch_ns;           /* Fork to successful exec, -1 if unknown */
+    int pidfd;                     /* Watched by the event loop, -1 if not */
+    int running;                   /* Not reaped yet */
+    int timer_fd;                  /* Deadline timerfd, -1 if none */
+    long long grace_ns;            /* Deadline's TERM to KILL delay */
+    int timed_out;                 /* Deadline signals sent so far */
+    int pipe_size;                 /* Capacity of the pipe it writes, 0 if untuned */
+    long long wall_ns;             /* Fork to reap */
+    long long utime_us;            /* User CPU time */
+    long long stime_us;            /* System CPU time */
+    long maxrss_kb;                /* Peak resident set size */
+    long nvcsw;                    /* Voluntary context switches */
+    long nivcsw;                   /* Involuntary context switches */
+} proc_stats_t;
+
+/* HDR-style latency histogram: log2 buckets split into HIST_SUB linear steps */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    unsigned long long count;      /* Values recorded */
+    unsigned long long max;        /* Largest value recorded */
+    unsigned int buckets[HIST_BUCKETS];
+} latency_hist_t;
+
+/* Latency statistics for one command name */
+typedef struct {
+    char *name;                    /* Command name */
+    latency_hist_t launch;         /* Fork to exec, in ns */
+    latency_hist_t run;            /* Fork (or builtin start) to finish, in ns */
+    int pipe_size;                 /* Learned output pipe capacity, 0 if not yet */
+} cmd_stats_t;
+
+/* Command statistics keyed by name */
+typedef struct {
+    cmd_stats_t **entries;         /* Open-addressed hash table */
+    size_t capacity;               /* Slot count, a power of two */
+    size_t count;                  /* Entries in use */
+} stats_table_t;
+
+/* Allocation counters kept by shell_malloc/shell_free */
+typedef struct {
+    unsigned long long allocs;     /* Allocations since start */
+    unsigned long long frees;      /* Frees since start */
+    size_t live_bytes;             /* Usable bytes currently allocated */
+    size_t live_blocks;            /* Blocks currently allocated */
+    size_t live_nodes;             /* cmd_node_t currently allocated */
+    unsigned long long line_start_allocs; /* allocs when this line began */
+    unsigned long long last_line_allocs;  /* Allocations made by the last line */
+} mem_stats_t;
+
+/* Job and job process states */
+#define JOB_RUNNING 0
+#define JOB_STOPPED 1
+#define JOB_DONE    2
+
+/* One process of a job */
+typedef struct {
+    pid_t pid;
+    int pidfd;                     /* Owned by the job, -1 once reaped */
+    int state;                     /* JOB_* */
+    int status;                    /* Raw wait or stop status */
+} job_proc_t;
+
+/* A background or stopped pipeline */
+typedef struct {
+    int id;                        /* Job number, %id */
+    pid_t pgid;                    /* Process group, 0 without job control */
+    char *text;                    /* Command line for listings */
+    job_proc_t *procs;             /* Pipeline processes in order */
+    int nprocs;                    /* Entries in procs */
+    int live;                      /* Processes not reaped yet */
+    int state;                     /* JOB_* of the job as a whole */
+    int notify;                    /* State change not reported yet */
+    int has_tmodes;                /* tmodes saved when the job stopped */
+    struct termios tmodes;         /* Terminal modes to restore on fg */
+} job_t;
+
+/* Job table pid index entry */
+typedef struct {
+    pid_t pid;                     /* 0 = empty, -1 = removed */
+    int id;                        /* Job number */
+    int proc;                      /* Index in the job's procs */
+} job_pid_t;
+
+/* Jobs by number, plus a pid index */
+typedef struct {
+    job_t **slots;                 /* Indexed by job number, NULL if free */
+    int capacity;                  /* Entries allocated in slots */
+    int highest;                   /* Largest job number in use, 0 if none */
+    int current;                   /* Job number of %+, 0 if none */
+    int previous;                  /* Job number of %-, 0 if none */
+    job_pid_t *pids;               /* Open-addressed hash table keyed by pid */
+    size_t pid_capacity;           /* Slot count, a power of two */
+    size_t pid_count;              /* Pids in the index */
+    size_t pid_tombstones;         /* Slots of removed pids */
+} job_table_t;
+
+/* Variable attribute flags */
+#define VAR_EXPORT   0x1           /* Passed to child processes */
+#define VAR_READONLY 0x2           /* Cannot be changed or unset */
+
+/* Variable store entry */
+typedef struct {
+    char *entry;                   /* "NAME=VALUE" (or "NAME" if no value) */
+    size_t name_len;               /* Length of NAME */
+    unsigned int hash;             /* Hash of NAME */
+    int flags;                     /* VAR_* attribute flags */
+    int has_value;                 /* Entry carries "=VALUE" */
+} var_entry_t;
+
+/* Hashed shell variable store */
+typedef struct {
+    var_entry_t *slots;            /* Open-addressed hash table */
+    size_t capacity;               /* Slot count, a power of two */
+    size_t count;                  /* Live variables */
+    size_t tombstones;             /* Slots of removed variables */
+    size_t exported;               /* Variables that go into envp */
+    char **envp;                   /* Cached environment for execve() */
+    int envp_valid;                /* envp matches the table */
+} var_store_t;
+
 /* Shell context */
 typedef struct {
-    char **environ;                /* Environment variables */
+    var_store_t *vars;             /* Shell and environment variables */
     int last_exit_status;         /* Last command exit status */
-    char current_dir[MAX_PATH];   /* Current working directory */
+    char current_dir[MAX_PATH];   /* Current working directory, "" until needed */
+    int exec_tail;                /* Chain is the last thing this shell runs */
+    int interactive;              /* Reading commands from a terminal */
+    int noexec;                   /* -n: parse commands but don't run them */
+    int forkserver_fd;            /* Socket to the fork server, -1 if none */
+    pid_t forkserver_pid;         /* Fork server helper process */
+    proc_stats_t *proc_stats;     /* Children of the last pipeline run */
+    int proc_count;               /* Entries used in proc_stats */
+    int proc_capacity;            /* Entries allocated in proc_stats */
+    stats_table_t cmd_stats;      /* Latency histograms per command name */
+    int lineno;                   /* Number of the input line being run */
+    int xtrace;                   /* set -x: trace commands to stderr */
+    int optimize;                 /* set -o optimize: rewrite chains first */
+    int epoll_fd;                 /* Event loop epoll set, -1 if none */
+    int signal_fd;                /* signalfd for SIGINT/SIGCHLD/SIGWINCH */
+    int interrupted;              /* SIGINT seen by the event loop */
+    job_table_t jobs;             /* Background and stopped jobs */
+    int job_control;              /* Pipelines get process groups and the terminal */
+    pid_t shell_pgid;             /* The shell's own process group */
+    pid_t fg_pgid;                /* Group owning the terminal, 0 if the shell */
+    int fg_stopped;               /* Stop signal of the foreground pipeline */
+    struct termios shell_tmodes;  /* Terminal modes to restore after a job */
+    long long timeout_ns;         /* timeout builtin's deadline, -1 none, 0 unset */
+    long long timeout_grace_ns;   /* timeout builtin's TERM to KILL delay */
 } shell_context_t;
 
+/* Builtin lookup results stored in cmd_node_t.builtin_id */
+#define BUILTIN_NONE       -1      /* External command */
+#define BUILTIN_UNRESOLVED -2      /* Not looked up yet */
+
+/* Builtin flags */
+#define BUILTIN_SPECIAL 0x1        /* Changes shell state; runs in the shell */
+
+/* Builtin table entry */
+typedef struct {
+    const char *name;              /* Command name */
+    int (*fn)(char **args, shell_context_t *ctx);
+    int flags;                     /* BUILTIN_* flags */
+} builtin_t;
+
 /* Function prototypes */
 
 /* Command chain management */
@@ -72,29 +248,179 @@ int execute_command_chain(command_chain_t *chain, shell_context_t *ctx);
 int execute_single_command(cmd_node_t *cmd, shell_context_t *ctx);
 int execute_builtin_command(cmd_node_t *cmd, shell_context_t *ctx);
 int execute_external_command(cmd_node_t *cmd, shell_context_t *ctx);
-int execute_piped_commands(cmd_node_t *cmd1, cmd_node_t *cmd2, shell_context_t *ctx);
+int execute_external_args(const char *name, char **args, shell_context_t *ctx);
+int exec_command_in_place(cmd_node_t *cmd, shell_context_t *ctx);
+char* find_command_path(const char *name, const char *path);
+const char* resolve_command(cmd_node_t *cmd, shell_context_t *ctx);
+proc_stats_t* record_child(shell_context_t *ctx, cmd_node_t *cmd, pid_t pid,
+                           long long start_ns);
+void finish_child(shell_context_t *ctx, proc_stats_t *ps, int status,
+                  const struct rusage *ru);
+void reap_background_jobs(shell_context_t *ctx);
+int exit_code(int status);
+
+/* Job control */
+job_t* job_create(shell_context_t *ctx, cmd_node_t *first, int stages, pid_t pgid);
+int job_add_process(shell_context_t *ctx, job_t *job, pid_t pid, int pidfd);
+job_t* job_get(shell_context_t *ctx, int id);
+job_t* job_by_pid(shell_context_t *ctx, pid_t pid, int *proc);
+void job_finished(shell_context_t *ctx, pid_t pid, int status);
+int job_stopped(shell_context_t *ctx, pid_t pid, int sig);
+void jobs_check_stopped(shell_context_t *ctx);
+void jobs_notify(shell_context_t *ctx);
+int job_stop_foreground(shell_context_t *ctx, cmd_node_t *first, int stages);
+void job_started(shell_context_t *ctx, job_t *job);
+void job_launch_child(shell_context_t *ctx, pid_t pgid, int foreground);
+void job_launch_parent(shell_context_t *ctx, pid_t pid, pid_t pgid, int foreground);
+void job_reclaim_terminal(shell_context_t *ctx);
+void jobs_init(shell_context_t *ctx);
+void jobs_free(shell_context_t *ctx);
+int builtin_jobs(char **args, shell_context_t *ctx);
+int builtin_fg(char **args, shell_context_t *ctx);
+int builtin_bg(char **args, shell_context_t *ctx);
+int builtin_kill(char **args, shell_context_t *ctx);
+
+/* Command deadlines (timeout builtin and TMOUT_CMD) */
+int parse_duration(const char *text, long long *ns);
+long long command_timeout(shell_context_t *ctx, long long *grace_ns);
+int builtin_timeout(char **args, shell_context_t *ctx);
+
+/* Zero-copy cat and tee builtins */
+int write_all(int fd, const char *buf, size_t len);
+int builtin_cat(char **args, shell_context_t *ctx);
+int builtin_tee(char **args, shell_context_t *ctx);
+
+/* test, [ and printf builtins */
+int builtin_test(char **args, shell_context_t *ctx);
+int builtin_bracket(char **args, shell_context_t *ctx);
+int builtin_printf(char **args, shell_context_t *ctx);
+
+/* Chain optimizer (set -o optimize) and the explain builtin */
+int optimize_chain(command_chain_t *chain, shell_context_t *ctx, FILE *notes);
+void print_plan(FILE *out, command_chain_t *chain);
+int builtin_explain(char **args, shell_context_t *ctx);
+
+/* Pipe capacity between pipeline stages (PIPE_SIZE) */
+int pipe_tune(shell_context_t *ctx, int write_fd, cmd_node_t *cmd);
+void pipe_observe(shell_context_t *ctx, const proc_stats_t *ps);
+
+/* Fork server (optional low-latency launcher) */
+int forkserver_start(shell_context_t *ctx);
+void forkserver_stop(shell_context_t *ctx);
+int forkserver_run(shell_context_t *ctx, cmd_node_t *cmd, const char *path,
+                   char **argv, char **envp, int fds[3], int *status);
+int execute_piped_commands(cmd_node_t *first, int stages, shell_context_t *ctx);
 
 /* Built-in commands */
 int builtin_cd(char **args, shell_context_t *ctx);
 int builtin_pwd(char **args, shell_context_t *ctx);
 int builtin_echo(char **args, shell_context_t *ctx);
+int builtin_true(char **args, shell_context_t *ctx);
+int builtin_false(char **args, shell_context_t *ctx);
 int builtin_env(char **args, shell_context_t *ctx);
 int builtin_exit(char **args, shell_context_t *ctx);
+int builtin_export(char **args, shell_context_t *ctx);
+int builtin_unset(char **args, shell_context_t *ctx);
+int builtin_readonly(char **args, shell_context_t *ctx);
+int builtin_stats(char **args, shell_context_t *ctx);
+int builtin_meminfo(char **args, shell_context_t *ctx);
+int builtin_set(char **args, shell_context_t *ctx);
+
+/* Latency statistics */
+void hist_record(latency_hist_t *hist, long long value);
+unsigned long long hist_percentile(const latency_hist_t *hist, double percentile);
+cmd_stats_t* stats_lookup(stats_table_t *table, const char *name);
+void stats_record(stats_table_t *table, const char *name,
+                  long long launch_ns, long long run_ns);
+void stats_free(stats_table_t *table);
+
+/* Variable store */
+var_store_t* var_store_create(char **env);
+void var_store_free(var_store_t *store);
+const char* var_get(var_store_t *store, const char *name);
+int var_set(var_store_t *store, const char *name, const char *value, int flags);
+int var_unset(var_store_t *store, const char *name);
+int var_valid_name(const char *name, size_t len);
+char** var_envp(var_store_t *store);
+void var_print(var_store_t *store, int flag, const char *prefix);
+
+/* Builtin dispatch */
+int lookup_builtin(const char *name);
+int cmd_builtin_id(cmd_node_t *cmd);
+const builtin_t* get_builtin(int id);
 
 /* Utility functions */
 int is_builtin_command(const char *command);
 char** copy_args(char **args, int argc);
 void print_prompt(void);
 void handle_signals(void);
+const char* get_current_dir(shell_context_t *ctx);
 
 /* Shell initialization and cleanup */
 shell_context_t* init_shell_context(void);
 void cleanup_shell_context(shell_context_t *ctx);
 
+/* Execution tracing (Chrome Trace Event JSON) */
+extern int trace_enabled;
+#define TRACE_ON() __builtin_expect(trace_enabled, 0)
+long long trace_now(void);
+void trace_init(const char *path);
+void trace_record(const char *name, const char *detail, long long start_ns,
+                  long long dur_ns, pid_t pid);
+void trace_flush(void);
+
+/* Event loop (epoll over signalfd, terminal and child pidfds) */
+int event_loop_init(shell_context_t *ctx);
+void event_loop_child(void);
+void event_loop_free(shell_context_t *ctx);
+pid_t fork_pidfd(int *pidfd);
+void fork_pidfd_threaded(void);
+int signal_child(pid_t pid, int pidfd, int sig);
+int event_watch_child(shell_context_t *ctx, pid_t pid, int pidfd, int job);
+pid_t event_wait_child(shell_context_t *ctx, pid_t target);
+void event_wait_jobs(shell_context_t *ctx);
+int event_interrupted(shell_context_t *ctx, int fd);
+int event_arm_timeout(shell_context_t *ctx, proc_stats_t *ps, long long timeout_ns,
+                      long long grace_ns);
+ssize_t event_read_line(shell_context_t *ctx, char **line, size_t *len);
+
+/* set -x tracing through a buffered writer */
+void xtrace_command(cmd_node_t *cmd, shell_context_t *ctx);
+void xtrace_flush(void);
+
+/* Script line profiler (collapsed stacks for flamegraph.pl) */
+extern int profile_enabled;
+#define PROFILE_ON() __builtin_expect(profile_enabled, 0)
+void profile_init(const char *path, const char *source, int weight_cpu);
+void profile_line_begin(int lineno, const char *text);
+void profile_line_end(void);
+void profile_pipeline(cmd_node_t *first, int stages, long long wall_ns,
+                      long long self_cpu_us, long long child_cpu_us);
+
+/* Session record and replay */
+extern int record_enabled;
+#define RECORD_ON() __builtin_expect(record_enabled, 0)
+void record_init(const char *path);
+void record_line(const char *line, long long start_ns, long long duration_ns, int status);
+int replay_session(const char *path, double speed, shell_context_t *ctx,
+                   void (*run)(const char *line, shell_context_t *ctx));
+
+/* Prometheus metrics on a unix socket */
+int metrics_start(const char *path);
+void metrics_command(int status, long long launch_ns);
+void metrics_fork_failure(void);
+void metrics_jobs(int delta);
+
 /* Command parsing (placeholder for your partner's parser) */
 command_chain_t* parse_command_line(const char *line);
 
 /* Utility function for string duplication (POSIX compatibility) */
 char* shell_strdup(const char *s);
 
+/* Counted allocation (parser and command chain) */
+extern mem_stats_t shell_mem;
+void* shell_malloc(size_t size);
+void shell_free(void *ptr);
+void mem_line_mark(void);
+
 #endif /* SHELL_H */
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "shell.h"
+
+/*
+ * Per-command latency statistics
+ *
+ * Each command name gets two HDR-style histograms: launch latency (fork
+ * until exec succeeded) and total run time (fork until reaped). Buckets
+ * are log-spaced with HIST_SUB linear sub-buckets per power of two, so
+ * any value up to 2^64 ns is recorded with ~6% precision in fixed space
+ * and percentiles can be read straight off the counts.
+ */
+
+#define STATS_INITIAL_CAPACITY 32
+
+/**
+ * Bucket index for a value
+ */
+static int hist_index(unsigned long long value) {
+    if (value < HIST_SUB) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+           (int)((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/**
+ * Smallest value that falls in a bucket
+ */
+static unsigned long long hist_lower_bound(int index) {
+    if (index < HIST_SUB) {
+        return index;
+    }
+
+    int group = index / HIST_SUB;
+    return (unsigned long long)(HIST_SUB + index % HIST_SUB) << (group - 1);
+}
+
+/**
+ * Record one value in a histogram
+ */
+void hist_record(latency_hist_t *hist, long long value) {
+    if (value < 0) return;
+
+    hist->buckets[hist_index((unsigned long long)value)]++;
+    hist->count++;
+    if ((unsigned long long)value > hist->max) {
+        hist->max = value;
+    }
+}
+
+/**
+ * Value at a percentile (0-100). Reports the lower bound of the bucket
+ * holding that rank, capped at the recorded maximum.
+ */
+unsigned long long hist_percentile(const latency_hist_t *hist, double percentile) {
+    if (hist->count == 0) return 0;
+
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * hist->count + 0.5);
+    unsigned long long seen = 0;
+
+    if (rank < 1) rank = 1;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            unsigned long long value = hist_lower_bound(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+/**
+ * Hash a command name
+ */
+static unsigned int stats_hash(const char *name) {
+    unsigned int hash = 2166136261u;
+
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Insert an entry into a table that is known to have room
+ */
+static void stats_insert(stats_table_t *table, cmd_stats_t *entry) {
+    size_t mask = table->capacity - 1;
+    size_t i = stats_hash(entry->name) & mask;
+
+    while (table->entries[i]) {
+        i = (i + 1) & mask;
+    }
+    table->entries[i] = entry;
+}
+
+/**
+ * Find or create the statistics entry for a command name
+ */
+cmd_stats_t* stats_lookup(stats_table_t *table, const char *name) {
+    if (table->capacity == 0 || (table->count + 1) * 2 > table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : STATS_INITIAL_CAPACITY;
+        cmd_stats_t **entries = calloc(capacity, sizeof(cmd_stats_t*));
+        if (!entries) {
+            perror("calloc");
+            return NULL;
+        }
+
+        cmd_stats_t **old = table->entries;
+        size_t old_capacity = table->capacity;
+        table->entries = entries;
+        table->capacity = capacity;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i]) stats_insert(table, old[i]);
+        }
+        free(old);
+    }
+
+    size_t mask = table->capacity - 1;
+    size_t i = stats_hash(name) & mask;
+
+    while (table->entries[i]) {
+        if (strcmp(table->entries[i]->name, name) == 0) {
+            return table->entries[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    cmd_stats_t *entry = calloc(1, sizeof(cmd_stats_t));
+    if (!entry || !(entry->name = shell_strdup(name))) {
+        free(entry);
+        return NULL;
+    }
+
+    table->entries[i] = entry;
+    table->count++;
+    return entry;
+}
+
+/**
+ * Record a finished command's launch latency (-1 if unknown) and run time
+ */
+void stats_record(stats_table_t *table, const char *name,
+                  long long launch_ns, long long run_ns) {
+    cmd_stats_t *entry = stats_lookup(table, name);
+    if (!entry) return;
+
+    hist_record(&entry->launch, launch_ns);
+    hist_record(&entry->run, run_ns);
+}
+
+/**
+ * Free all statistics
+ */
+void stats_free(stats_table_t *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i]) {
+            shell_free(table->entries[i]->name);
+            free(table->entries[i]);
+        }
+    }
+
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+/**
+ * Print a nanosecond value with a readable unit
+ */
+static void print_duration(unsigned long long ns) {
+    if (ns < 10000ULL) {
+        printf(" %7lluns", ns);
+    } else if (ns < 10000000ULL) {
+        printf(" %7.1fus", ns / 1e3);
+    } else if (ns < 10000000000ULL) {
+        printf(" %7.1fms", ns / 1e6);
+    } else {
+        printf(" %7.1fs ", ns / 1e9);
+    }
+}
+
+/**
+ * Print p50/p90/p99/p99.9 of a histogram
+ */
+static void print_percentiles(const latency_hist_t *hist) {
+    static const double points[] = {50, 90, 99, 99.9};
+
+    for (int i = 0; i < 4; i++) {
+        if (hist->count == 0) {
+            printf(" %9s", "-");
+        } else {
+            print_duration(hist_percentile(hist, points[i]));
+        }
+    }
+}
+
+/**
+ * Compare entries by name for the report
+ */
+static int stats_cmp(const void *a, const void *b) {
+    return strcmp((*(cmd_stats_t *const *)a)->name, (*(cmd_stats_t *const *)b)->name);
+}
+
+/**
+ * Built-in stats command: latency percentiles per command name
+ */
+int builtin_stats(char **args, shell_context_t *ctx) {
+    stats_table_t *table = &ctx->cmd_stats;
+
+    if (args && args[0] && strcmp(args[0], "-r") == 0) {
+        stats_free(table);
+        return 0;
+    }
+
+    cmd_stats_t **list = malloc((table->count + 1) * sizeof(cmd_stats_t*));
+    size_t n = 0;
+    if (!list) {
+        perror("malloc");
+        return 1;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i]) list[n++] = table->entries[i];
+    }
+    qsort(list, n, sizeof(cmd_stats_t*), stats_cmp);
+
+    printf("%-16s %7s %9s %9s %9s %9s  %9s %9s %9s %9s\n", "command", "runs",
+           "launch50", "launch90", "launch99", "launch999",
+           "run50", "run90", "run99", "run999");
+    for (size_t i = 0; i < n; i++) {
+        printf("%-16s %7llu", list[i]->name, (unsigned long long)list[i]->run.count);
+        print_percentiles(&list[i]->launch);
+        printf(" ");
+        print_percentiles(&list[i]->run);
+        printf("\n");
+    }
+
+    free(list);
+    return 0;
+}
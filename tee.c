@@ -0,0 +1,294 @@
+#include "shell.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * Built-in tee
+ *
+ * Copies stdin to stdout and every named file. When stdin is a pipe
+ * (the usual `cmd | tee log | cmd2`) the data stays in the kernel: each
+ * round tee(2) duplicates what is buffered in stdin into a private
+ * staging pipe, splice(2) moves the copy on to one output, and so on for
+ * every output but the last, which gets the original bytes spliced
+ * straight out of stdin. The staging pipe is as large as stdin's, so a
+ * duplicate of the first round's length always fits whole.
+ *
+ * Outputs splice() refuses (O_APPEND files with -a, some terminals) are
+ * fed from a buffer instead, and a stdin that isn't a pipe is copied
+ * with read/write throughout. An output that fails is reported and
+ * dropped; the rest carry on and tee exits 1, as coreutils tee does.
+ *
+ * Like cat, each round first checks for ^C in an interactive shell and
+ * stops with status 130. Options other than -a, reading an interactive
+ * terminal and runs with a deadline go to the external tee (see cat.c).
+ */
+
+#define TEE_BUFFER (128 * 1024)    /* Read/write fallback buffer */
+
+typedef struct {
+    const char *name;              /* For messages */
+    int fd;                        /* -1 once it has failed */
+    int splice;                    /* splice() works for this output */
+} tee_out_t;
+
+static char tee_buffer[TEE_BUFFER];
+
+/**
+ * Report a failed output and stop writing to it
+ */
+static void tee_drop(tee_out_t *out) {
+    fprintf(stderr, "tee: %s: %s\n", out->name, strerror(errno));
+    if (out->fd > STDERR_FILENO) {
+        close(out->fd);
+    }
+    out->fd = -1;
+}
+
+/**
+ * Move up to len bytes from pipe src to an output in one step. Returns
+ * the bytes moved, 0 at end of input, or -1 on error.
+ */
+static ssize_t tee_move_some(int src, tee_out_t *out, size_t len) {
+    for (;;) {
+        ssize_t n;
+
+        if (out->splice) {
+            n = splice(src, NULL, out->fd, NULL, len, SPLICE_F_MOVE);
+            if (n == -1 && errno == EINVAL) {
+                out->splice = 0;
+                continue;
+            }
+        } else {
+            n = read(src, tee_buffer, len < sizeof(tee_buffer) ? len : sizeof(tee_buffer));
+            if (n > 0 && write_all(out->fd, tee_buffer, n) == -1) return -1;
+        }
+
+        if (n == -1 && errno == EINTR) continue;
+        return n;
+    }
+}
+
+/**
+ * Move exactly len bytes from pipe src to an output. On failure the
+ * output is dropped. Returns the bytes left unmoved in src (0 on success).
+ */
+static size_t tee_move(int src, tee_out_t *out, size_t len) {
+    while (len > 0) {
+        ssize_t n = tee_move_some(src, out, len);
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            tee_drop(out);
+            return len;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Throw away len bytes of a pipe
+ */
+static void tee_discard(int src, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(src, tee_buffer, len < sizeof(tee_buffer) ? len : sizeof(tee_buffer));
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return;
+        len -= n;
+    }
+}
+
+/**
+ * Copy pipe in to every output with tee() and splice(). Returns 0, 1 if
+ * an output failed, or EXIT_INTERRUPTED after ^C.
+ */
+static int tee_from_pipe(shell_context_t *ctx, int in, tee_out_t *outs, int count) {
+    int stage[2];
+    int status = 0;
+
+    if (pipe2(stage, O_CLOEXEC) == -1) {
+        perror("tee: pipe");
+        return 1;
+    }
+
+    /* A staging pipe at least as large as stdin takes a whole round */
+    int in_size = fcntl(in, F_GETPIPE_SZ);
+    if (in_size > 0) {
+        fcntl(stage[1], F_SETPIPE_SZ, in_size);
+    }
+    int stage_size = fcntl(stage[1], F_GETPIPE_SZ);
+    if (stage_size <= 0) {
+        stage_size = TEE_BUFFER;
+    }
+
+    for (;;) {
+        int last = count - 1;
+        while (last >= 0 && outs[last].fd < 0) {
+            last--;
+        }
+        if (last < 0) break; /* Nothing left to write to */
+
+        if (event_interrupted(ctx, in)) {
+            status = EXIT_INTERRUPTED;
+            break;
+        }
+
+        /* Round length: set by the first tee(), or the last output's splice */
+        ssize_t n = -1;
+
+        for (int i = 0; i < last; i++) {
+            if (outs[i].fd < 0) continue;
+
+            ssize_t got;
+            do {
+                got = tee(in, stage[1], n < 0 ? (size_t)stage_size : (size_t)n, 0);
+            } while (got == -1 && errno == EINTR);
+
+            if (got == -1 || (n >= 0 && got != n)) {
+                if (got >= 0) errno = EIO;
+                perror("tee");
+                close(stage[0]);
+                close(stage[1]);
+                return 1;
+            }
+            if (n < 0) {
+                n = got;
+                if (n == 0) goto done;
+            }
+
+            size_t left = tee_move(stage[0], &outs[i], got);
+            if (left > 0) {
+                tee_discard(stage[0], left);
+                status = 1;
+            }
+        }
+
+        if (n < 0) {
+            n = tee_move_some(in, &outs[last], stage_size);
+            if (n == 0) break;
+            if (n == -1) {
+                tee_drop(&outs[last]);
+                status = 1;
+            }
+            continue;
+        }
+
+        size_t left = tee_move(in, &outs[last], n);
+        if (left > 0) {
+            tee_discard(in, left);
+            status = 1;
+        }
+    }
+
+done:
+    close(stage[0]);
+    close(stage[1]);
+    return status;
+}
+
+/**
+ * Copy any other kind of stdin to every output through a buffer. wait_fd
+ * is in unless it is a regular file, -1 then. Returns 0, 1 if reading or
+ * an output failed, or EXIT_INTERRUPTED after ^C.
+ */
+static int tee_from_file(shell_context_t *ctx, int in, int wait_fd, tee_out_t *outs,
+                         int count) {
+    int status = 0;
+
+    for (;;) {
+        if (event_interrupted(ctx, wait_fd)) return EXIT_INTERRUPTED;
+
+        ssize_t n = read(in, tee_buffer, sizeof(tee_buffer));
+        if (n == 0) break;
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("tee: read");
+            return 1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (outs[i].fd >= 0 && write_all(outs[i].fd, tee_buffer, n) == -1) {
+                tee_drop(&outs[i]);
+                status = 1;
+            }
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Built-in tee command: tee [-a] [file...]
+ */
+int builtin_tee(char **args, shell_context_t *ctx) {
+    int append = 0;
+    int i = 0;
+
+    for (; args && args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(args[i], "-a") != 0) {
+            return execute_external_args("tee", args, ctx);
+        }
+        append = 1;
+    }
+
+    if ((ctx->interactive && isatty(STDIN_FILENO)) || command_timeout(ctx, NULL) > 0) {
+        return execute_external_args("tee", args, ctx);
+    }
+
+    int files = 0;
+    while (args && args[i + files]) {
+        files++;
+    }
+
+    tee_out_t *outs = malloc((files + 1) * sizeof(tee_out_t));
+    if (!outs) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* Output written by other builtins comes first */
+    fflush(stdout);
+    outs[0].name = "standard output";
+    outs[0].fd = STDOUT_FILENO;
+    outs[0].splice = 1;
+
+    int count = 1;
+    int status = 0;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    for (int f = 0; f < files; f++) {
+        int fd = open(args[i + f], flags, 0666);
+        if (fd == -1) {
+            fprintf(stderr, "tee: %s: %s\n", args[i + f], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[count].name = args[i + f];
+        outs[count].fd = fd;
+        outs[count].splice = 1;
+        count++;
+    }
+
+    struct stat in_st;
+    int have_st = fstat(STDIN_FILENO, &in_st) == 0;
+    int copied;
+    if (have_st && S_ISFIFO(in_st.st_mode)) {
+        copied = tee_from_pipe(ctx, STDIN_FILENO, outs, count);
+    } else {
+        int wait_fd = have_st && S_ISREG(in_st.st_mode) ? -1 : STDIN_FILENO;
+        copied = tee_from_file(ctx, STDIN_FILENO, wait_fd, outs, count);
+    }
+    status = copied == EXIT_INTERRUPTED ? copied : status | copied;
+
+    for (int o = 1; o < count; o++) {
+        if (outs[o].fd >= 0) {
+            close(outs[o].fd);
+        }
+    }
+    free(outs);
+
+    return status;
+}
@@ -0,0 +1,317 @@
+#include "shell.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+
+/*
+ * Built-in test and [
+ *
+ * POSIX test: with up to four arguments the result is decided by the
+ * argument count rules of the standard (so `test -n` and `test ! = x`
+ * mean what they must), longer expressions are parsed with the XSI
+ * operators -a, -o, ! and parentheses, -a binding tighter than -o.
+ *
+ * Exit status is 0 for true, 1 for false and 2 for a usage error.
+ */
+
+#define TEST_ERROR 2
+
+typedef struct {
+    const char *name;              /* "test" or "[", for messages */
+    char **args;                   /* Expression words */
+    int count;                     /* Words in args */
+    int pos;                       /* Next word to parse */
+    int error;                     /* Set on a syntax or number error */
+} test_state_t;
+
+/**
+ * Report a usage error once
+ */
+static int test_error(test_state_t *st, const char *what, const char *word) {
+    if (!st->error) {
+        if (word) {
+            fprintf(stderr, "%s: %s: %s\n", st->name, word, what);
+        } else {
+            fprintf(stderr, "%s: %s\n", st->name, what);
+        }
+        st->error = 1;
+    }
+    return 0;
+}
+
+/**
+ * Parse an integer operand (leading/trailing blanks allowed)
+ */
+static int test_integer(test_state_t *st, const char *word, long long *value) {
+    char *end;
+
+    errno = 0;
+    *value = strtoll(word, &end, 10);
+    while (*end == ' ' || *end == '\t') {
+        end++;
+    }
+    if (end == word || *end != '\0' || errno == ERANGE) {
+        test_error(st, "integer expression expected", word);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Whether op is a unary file or string primary
+ */
+static int unary_primary(const char *op) {
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefghLnprSstuwxzkGO", op[1]);
+}
+
+/**
+ * Whether op is a binary primary
+ */
+static int binary_primary(const char *op) {
+    static const char *const ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-gt", "-ge", "-lt", "-le",
+        "-nt", "-ot", "-ef", NULL
+    };
+
+    for (int i = 0; ops[i]; i++) {
+        if (strcmp(op, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Evaluate a unary primary
+ */
+static int test_unary(test_state_t *st, const char *op, const char *arg) {
+    struct stat sb;
+
+    switch (op[1]) {
+    case 'n': return *arg != '\0';
+    case 'z': return *arg == '\0';
+    case 't': {
+        long long fd;
+        if (test_integer(st, arg, &fd) == -1) return 0;
+        return fd >= 0 && fd <= INT_MAX && isatty((int)fd);
+    }
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    case 'h':
+    case 'L': return lstat(arg, &sb) == 0 && S_ISLNK(sb.st_mode);
+    }
+
+    if (stat(arg, &sb) == -1) return 0;
+
+    switch (op[1]) {
+    case 'e': return 1;
+    case 'f': return S_ISREG(sb.st_mode);
+    case 'd': return S_ISDIR(sb.st_mode);
+    case 'b': return S_ISBLK(sb.st_mode);
+    case 'c': return S_ISCHR(sb.st_mode);
+    case 'p': return S_ISFIFO(sb.st_mode);
+    case 'S': return S_ISSOCK(sb.st_mode);
+    case 's': return sb.st_size > 0;
+    case 'g': return (sb.st_mode & S_ISGID) != 0;
+    case 'u': return (sb.st_mode & S_ISUID) != 0;
+    case 'k': return (sb.st_mode & S_ISVTX) != 0;
+    case 'G': return sb.st_gid == getegid();
+    case 'O': return sb.st_uid == geteuid();
+    }
+    return 0;
+}
+
+/**
+ * Compare two modification times, a before b
+ */
+static int mtime_before(const struct stat *a, const struct stat *b) {
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec) {
+        return a->st_mtim.tv_sec < b->st_mtim.tv_sec;
+    }
+    return a->st_mtim.tv_nsec < b->st_mtim.tv_nsec;
+}
+
+/**
+ * Evaluate a binary primary
+ */
+static int test_binary(test_state_t *st, const char *left, const char *op, const char *right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(left, right) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(left, right) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(left, right) > 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || (op[1] == 'e' && op[2] == 'f')) {
+        struct stat a, b;
+        int have_a = stat(left, &a) == 0;
+        int have_b = stat(right, &b) == 0;
+
+        if (strcmp(op, "-ef") == 0) {
+            return have_a && have_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        }
+        if (strcmp(op, "-nt") == 0) {
+            return have_a && (!have_b || mtime_before(&b, &a));
+        }
+        return have_b && (!have_a || mtime_before(&a, &b)); /* -ot */
+    }
+
+    long long a, b;
+    if (test_integer(st, left, &a) == -1 || test_integer(st, right, &b) == -1) return 0;
+
+    if (strcmp(op, "-eq") == 0) return a == b;
+    if (strcmp(op, "-ne") == 0) return a != b;
+    if (strcmp(op, "-gt") == 0) return a > b;
+    if (strcmp(op, "-ge") == 0) return a >= b;
+    if (strcmp(op, "-lt") == 0) return a < b;
+    return a <= b; /* -le */
+}
+
+static int test_or(test_state_t *st);
+
+/**
+ * primary: ( expr ) | ! primary | unary-op word | word binary-op word | word
+ */
+static int test_primary(test_state_t *st) {
+    if (st->pos >= st->count) {
+        return test_error(st, "argument expected", NULL);
+    }
+
+    char *word = st->args[st->pos];
+    int left = st->count - st->pos;
+
+    if (strcmp(word, "!") == 0) {
+        st->pos++;
+        return !test_primary(st);
+    }
+
+    if (left >= 3 && binary_primary(st->args[st->pos + 1])) {
+        st->pos += 3;
+        return test_binary(st, word, st->args[st->pos - 2], st->args[st->pos - 1]);
+    }
+
+    if (strcmp(word, "(") == 0) {
+        st->pos++;
+        int result = test_or(st);
+        if (st->pos >= st->count || strcmp(st->args[st->pos], ")") != 0) {
+            return test_error(st, "')' expected", NULL);
+        }
+        st->pos++;
+        return result;
+    }
+
+    if (left >= 2 && unary_primary(word)) {
+        st->pos += 2;
+        return test_unary(st, word, st->args[st->pos - 1]);
+    }
+
+    st->pos++;
+    return *word != '\0';
+}
+
+/**
+ * and: primary (-a primary)*
+ */
+static int test_and(test_state_t *st) {
+    int result = test_primary(st);
+
+    while (st->pos < st->count && strcmp(st->args[st->pos], "-a") == 0) {
+        st->pos++;
+        result = test_primary(st) && result;
+    }
+    return result;
+}
+
+/**
+ * or: and (-o and)*
+ */
+static int test_or(test_state_t *st) {
+    int result = test_and(st);
+
+    while (st->pos < st->count && strcmp(st->args[st->pos], "-o") == 0) {
+        st->pos++;
+        result = test_and(st) || result;
+    }
+    return result;
+}
+
+/**
+ * Evaluate args[0..count) by the POSIX argument count rules
+ */
+static int test_eval(test_state_t *st, char **args, int count) {
+    switch (count) {
+    case 0:
+        return 0;
+    case 1:
+        return *args[0] != '\0';
+    case 2:
+        if (strcmp(args[0], "!") == 0) return *args[1] == '\0';
+        if (unary_primary(args[0])) return test_unary(st, args[0], args[1]);
+        return test_error(st, "unary operator expected", args[0]);
+    case 3:
+        if (binary_primary(args[1])) return test_binary(st, args[0], args[1], args[2]);
+        if (strcmp(args[0], "!") == 0) return !test_eval(st, args + 1, 2);
+        if (strcmp(args[0], "(") == 0 && strcmp(args[2], ")") == 0) {
+            return *args[1] != '\0';
+        }
+        break;
+    case 4:
+        if (strcmp(args[0], "!") == 0) return !test_eval(st, args + 1, 3);
+        if (strcmp(args[0], "(") == 0 && strcmp(args[3], ")") == 0) {
+            return test_eval(st, args + 1, 2);
+        }
+        break;
+    }
+
+    /* More than four words, or shapes the count rules leave open */
+    st->args = args;
+    st->count = count;
+    st->pos = 0;
+    int result = test_or(st);
+    if (st->pos < st->count) {
+        return test_error(st, "too many arguments", NULL);
+    }
+    return result;
+}
+
+/**
+ * Evaluate an expression and map the result to an exit status
+ */
+static int run_test(const char *name, char **args, int count) {
+    test_state_t st = {0};
+
+    st.name = name;
+    int result = test_eval(&st, args, count);
+    return st.error ? TEST_ERROR : !result;
+}
+
+/**
+ * Built-in test command: test expression
+ */
+int builtin_test(char **args, shell_context_t *ctx) {
+    int count = 0;
+
+    (void)ctx;
+
+    while (args && args[count]) {
+        count++;
+    }
+    return run_test("test", args, count);
+}
+
+/**
+ * Built-in [ command: [ expression ]
+ */
+int builtin_bracket(char **args, shell_context_t *ctx) {
+    int count = 0;
+
+    (void)ctx;
+
+    while (args && args[count]) {
+        count++;
+    }
+    if (count == 0 || strcmp(args[count - 1], "]") != 0) {
+        fprintf(stderr, "[: missing ']'\n");
+        return TEST_ERROR;
+    }
+
+    /* The closing bracket is not part of the expression */
+    return run_test("[", args, count - 1);
+}
@@ -0,0 +1,120 @@
+#include "shell.h"
+
+/*
+ * Command deadlines
+ *
+ * `timeout DURATION cmd...` runs one command with a deadline, and a
+ * positive TMOUT_CMD gives every foreground external command a default
+ * one. The deadline is a timerfd armed next to the child's pidfd in the
+ * event loop (see event_arm_timeout()): when it fires the child gets
+ * SIGTERM, then SIGKILL after a grace period, and the command's status
+ * is EXIT_TIMEOUT. Unlike coreutils timeout there is no watchdog process
+ * in between.
+ *
+ * Builtins run inside the shell and are not bounded. cat and tee, which
+ * can run indefinitely, start the external tools instead when there is
+ * a deadline.
+ */
+
+#define TIMEOUT_GRACE_NS 2000000000LL  /* TERM to KILL unless -k is given */
+#define TIMEOUT_USAGE 125              /* timeout itself failed */
+
+/**
+ * Parse a duration: a number with an optional unit (ms, s, m, h or d;
+ * seconds if none). Returns -1 if it is malformed or negative.
+ */
+int parse_duration(const char *text, long long *ns) {
+    char *end;
+    double value = strtod(text, &end);
+    double scale = 1e9;
+
+    if (end == text || value < 0) return -1;
+
+    if (strcmp(end, "ms") == 0) {
+        scale = 1e6;
+    } else if (strcmp(end, "m") == 0) {
+        scale = 60e9;
+    } else if (strcmp(end, "h") == 0) {
+        scale = 3600e9;
+    } else if (strcmp(end, "d") == 0) {
+        scale = 86400e9;
+    } else if (*end != '\0' && strcmp(end, "s") != 0) {
+        return -1;
+    }
+
+    *ns = (long long)(value * scale);
+    return 0;
+}
+
+/**
+ * Deadline for the next foreground child: the one set by the timeout
+ * builtin, else TMOUT_CMD. Returns 0 if there is none. *grace_ns (if not
+ * NULL) receives the TERM to KILL delay.
+ */
+long long command_timeout(shell_context_t *ctx, long long *grace_ns) {
+    long long timeout_ns = ctx->timeout_ns;
+
+    if (grace_ns) {
+        *grace_ns = ctx->timeout_ns ? ctx->timeout_grace_ns : TIMEOUT_GRACE_NS;
+    }
+
+    /* -1: the timeout builtin asked for no deadline */
+    if (timeout_ns == 0) {
+        const char *tmout = var_get(ctx->vars, "TMOUT_CMD");
+        if (!tmout || !*tmout || parse_duration(tmout, &timeout_ns) == -1) {
+            return 0;
+        }
+    }
+
+    return timeout_ns > 0 ? timeout_ns : 0;
+}
+
+/**
+ * Built-in timeout command: timeout [-k GRACE] DURATION command [args...]
+ */
+int builtin_timeout(char **args, shell_context_t *ctx) {
+    long long timeout_ns, grace_ns = TIMEOUT_GRACE_NS;
+    int i = 0;
+
+    if (args && args[0] && strcmp(args[0], "-k") == 0) {
+        if (!args[1] || parse_duration(args[1], &grace_ns) == -1) {
+            fprintf(stderr, "timeout: invalid kill grace period\n");
+            return TIMEOUT_USAGE;
+        }
+        i = 2;
+    }
+
+    if (!args || !args[i] || !args[i + 1]) {
+        fprintf(stderr, "timeout: usage: timeout [-k grace] duration command [args...]\n");
+        return TIMEOUT_USAGE;
+    }
+    if (parse_duration(args[i], &timeout_ns) == -1) {
+        fprintf(stderr, "timeout: %s: invalid time interval\n", args[i]);
+        return TIMEOUT_USAGE;
+    }
+
+    /* Run the rest of the words as a command of its own */
+    cmd_node_t inner;
+    memset(&inner, 0, sizeof(inner));
+    inner.command = args[i + 1];
+    inner.args = args + i + 2;
+    while (inner.args[inner.argc]) {
+        inner.argc++;
+    }
+    inner.type = CMD_SIMPLE;
+    inner.builtin_id = BUILTIN_UNRESOLVED;
+
+    /* A zero duration means no deadline, as in coreutils */
+    long long saved_ns = ctx->timeout_ns;
+    long long saved_grace = ctx->timeout_grace_ns;
+    ctx->timeout_ns = timeout_ns > 0 ? timeout_ns : -1;
+    ctx->timeout_grace_ns = grace_ns;
+
+    int status = execute_single_command(&inner, ctx);
+
+    ctx->timeout_ns = saved_ns;
+    ctx->timeout_grace_ns = saved_grace;
+    shell_free(inner.path);
+
+    return status;
+}
@@ -0,0 +1,159 @@
+#include "shell.h"
+
+#include <stdint.h>
+
+/*
+ * Execution tracing
+ *
+ * With MINISHELL_TRACE=<file> set, the shell records timestamped spans
+ * (parse, resolve, fork, wait, builtin, child lifetimes) into an
+ * in-memory ring buffer and writes them out at exit as Chrome Trace Event
+ * JSON, which loads in Perfetto or chrome://tracing. Slots are claimed
+ * with an atomic increment so recording never takes a lock; when the
+ * buffer wraps the oldest events are overwritten. With tracing off every
+ * trace point is a single never-taken branch on trace_enabled.
+ */
+
+#define TRACE_CAPACITY (1 << 16)   /* Events kept; must be a power of two */
+#define TRACE_DETAIL 48            /* Bytes of detail text kept per event */
+
+typedef struct {
+    const char *name;               /* Static span name */
+    long long start_ns;             /* CLOCK_MONOTONIC start */
+    long long dur_ns;               /* Duration, -1 for an instant event */
+    int pid;                        /* Process the span belongs to */
+    char detail[TRACE_DETAIL];      /* Command line, command name, ... */
+} trace_event_t;
+
+int trace_enabled = 0;
+
+static trace_event_t *trace_ring;
+static uint64_t trace_next;          /* Total events ever recorded */
+static char *trace_path;
+static pid_t trace_owner;           /* Only this process writes the file */
+
+/**
+ * Current CLOCK_MONOTONIC time in nanoseconds
+ */
+long long trace_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Enable tracing to a file. The trace is written at exit.
+ */
+void trace_init(const char *path) {
+    trace_ring = calloc(TRACE_CAPACITY, sizeof(trace_event_t));
+    trace_path = shell_strdup(path);
+    if (!trace_ring || !trace_path) {
+        free(trace_ring);
+        shell_free(trace_path);
+        trace_ring = NULL;
+        trace_path = NULL;
+        return;
+    }
+
+    trace_owner = getpid();
+    trace_enabled = 1;
+    atexit(trace_flush);
+}
+
+/**
+ * Record a span. Pass dur_ns < 0 for an instant event.
+ */
+void trace_record(const char *name, const char *detail, long long start_ns,
+                  long long dur_ns, pid_t pid) {
+    uint64_t slot = __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+    trace_event_t *ev = &trace_ring[slot & (TRACE_CAPACITY - 1)];
+
+    ev->name = name;
+    ev->start_ns = start_ns;
+    ev->dur_ns = dur_ns;
+    ev->pid = pid ? pid : trace_owner;
+    if (detail) {
+        strncpy(ev->detail, detail, TRACE_DETAIL - 1);
+        ev->detail[TRACE_DETAIL - 1] = '\0';
+    } else {
+        ev->detail[0] = '\0';
+    }
+}
+
+/**
+ * Write a string as a JSON string literal
+ */
+static void trace_write_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Write the ring buffer out as Chrome Trace Event JSON
+ */
+void trace_flush(void) {
+    if (!trace_enabled || getpid() != trace_owner) return;
+
+    FILE *out = fopen(trace_path, "w");
+    if (!out) {
+        perror(trace_path);
+        return;
+    }
+
+    uint64_t end = __atomic_load_n(&trace_next, __ATOMIC_ACQUIRE);
+    uint64_t begin = end > TRACE_CAPACITY ? end - TRACE_CAPACITY : 0;
+    int first = 1;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    /* Name the shell's own track */
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"minishell\"}}", trace_owner);
+    first = 0;
+
+    for (uint64_t i = begin; i < end; i++) {
+        trace_event_t *ev = &trace_ring[i & (TRACE_CAPACITY - 1)];
+
+        if (!first) fputs(",\n", out);
+        first = 0;
+
+        /* Child processes get their own named track */
+        if (ev->pid != trace_owner) {
+            fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                    "\"args\":{\"name\":", ev->pid);
+            trace_write_string(out, ev->detail);
+            fputs("}},\n", out);
+        }
+
+        fprintf(out, "{\"name\":\"%s\",\"cat\":\"shell\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%.3f,", ev->name, ev->pid, ev->pid, ev->start_ns / 1000.0);
+        if (ev->dur_ns >= 0) {
+            fprintf(out, "\"ph\":\"X\",\"dur\":%.3f", ev->dur_ns / 1000.0);
+        } else {
+            fprintf(out, "\"ph\":\"i\",\"s\":\"p\"");
+        }
+        if (ev->detail[0]) {
+            fputs(",\"args\":{\"detail\":", out);
+            trace_write_string(out, ev->detail);
+            fputc('}', out);
+        }
+        fputc('}', out);
+    }
+
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    /* Don't write twice (e.g. flush before exec, then atexit) */
+    trace_enabled = 0;
+}
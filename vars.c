@@ -0,0 +1,354 @@
+#include "shell.h"
+
+/*
+ * Shell variable store
+ *
+ * Open-addressed hash table keyed by variable name. Each entry keeps its
+ * "NAME=VALUE" string ready to hand to execve(), so the exported envp is
+ * just an array of pointers into the table. That array is built lazily
+ * and shared by every exec until the next mutation marks it stale.
+ */
+
+#define VAR_INITIAL_CAPACITY 64
+
+/* Marks a slot whose entry was removed, so probing continues past it */
+static char var_tombstone;
+
+/**
+ * FNV-1a hash over a variable name of known length
+ */
+static unsigned int var_hash(const char *name, size_t len) {
+    unsigned int hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Find the slot for a name: either its entry or the empty slot where it
+ * would be inserted (reusing the first tombstone seen on the way).
+ */
+static var_entry_t* var_find_slot(var_store_t *store, const char *name,
+                                  size_t len, unsigned int hash) {
+    size_t mask = store->capacity - 1;
+    size_t i = hash & mask;
+    var_entry_t *reuse = NULL;
+
+    while (1) {
+        var_entry_t *slot = &store->slots[i];
+
+        if (!slot->entry) {
+            return reuse ? reuse : slot;
+        }
+
+        if (slot->entry == &var_tombstone) {
+            if (!reuse) reuse = slot;
+        } else if (slot->hash == hash && slot->name_len == len &&
+                   memcmp(slot->entry, name, len) == 0) {
+            return slot;
+        }
+
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * Rehash into a table of the given capacity, dropping tombstones
+ */
+static int var_resize(var_store_t *store, size_t capacity) {
+    var_entry_t *old = store->slots;
+    size_t old_capacity = store->capacity;
+
+    var_entry_t *slots = calloc(capacity, sizeof(var_entry_t));
+    if (!slots) {
+        perror("calloc");
+        return -1;
+    }
+
+    store->slots = slots;
+    store->capacity = capacity;
+    store->tombstones = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].entry && old[i].entry != &var_tombstone) {
+            var_entry_t *slot = var_find_slot(store, old[i].entry,
+                                              old[i].name_len, old[i].hash);
+            *slot = old[i];
+        }
+    }
+
+    free(old);
+    return 0;
+}
+
+/**
+ * Check that a string is a valid shell variable name
+ */
+int var_valid_name(const char *name, size_t len) {
+    if (len == 0 || !(name[0] == '_' || (name[0] >= 'A' && name[0] <= 'Z') ||
+                      (name[0] >= 'a' && name[0] <= 'z'))) {
+        return 0;
+    }
+
+    for (size_t i = 1; i < len; i++) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+              (c >= '0' && c <= '9'))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Create a variable store, importing an environment as exported variables
+ */
+var_store_t* var_store_create(char **env) {
+    var_store_t *store = malloc(sizeof(var_store_t));
+    if (!store) {
+        perror("malloc");
+        return NULL;
+    }
+
+    store->slots = NULL;
+    store->capacity = 0;
+    store->count = 0;
+    store->tombstones = 0;
+    store->exported = 0;
+    store->envp = NULL;
+    store->envp_valid = 0;
+
+    /* Size for the inherited environment up front to avoid rehashing */
+    size_t capacity = VAR_INITIAL_CAPACITY;
+    size_t env_count = 0;
+    for (char **e = env; e && *e; e++) {
+        env_count++;
+    }
+    while (capacity < env_count * 2) {
+        capacity *= 2;
+    }
+
+    if (var_resize(store, capacity) == -1) {
+        free(store);
+        return NULL;
+    }
+
+    for (char **e = env; e && *e; e++) {
+        const char *eq = strchr(*e, '=');
+        if (!eq) continue;
+
+        char *name = strndup(*e, eq - *e);
+        if (!name) {
+            perror("strndup");
+            continue;
+        }
+        var_set(store, name, eq + 1, VAR_EXPORT);
+        free(name);
+    }
+
+    return store;
+}
+
+/**
+ * Free a variable store
+ */
+void var_store_free(var_store_t *store) {
+    if (!store) return;
+
+    for (size_t i = 0; i < store->capacity; i++) {
+        if (store->slots[i].entry != &var_tombstone) {
+            free(store->slots[i].entry);
+        }
+    }
+
+    free(store->slots);
+    free(store->envp);
+    free(store);
+}
+
+/**
+ * Look up a variable entry by name
+ */
+static var_entry_t* var_lookup(var_store_t *store, const char *name) {
+    size_t len = strlen(name);
+    var_entry_t *slot = var_find_slot(store, name, len, var_hash(name, len));
+
+    return slot->entry && slot->entry != &var_tombstone ? slot : NULL;
+}
+
+/**
+ * Get a variable's value, or NULL if it is unset
+ */
+const char* var_get(var_store_t *store, const char *name) {
+    var_entry_t *var = var_lookup(store, name);
+
+    if (!var || !var->has_value) return NULL;
+    return var->entry + var->name_len + 1;
+}
+
+/**
+ * Set a variable and add attribute flags. A NULL value keeps the current
+ * value (or declares the name without one). Returns -1 if the variable is
+ * readonly or memory runs out.
+ */
+int var_set(var_store_t *store, const char *name, const char *value, int flags) {
+    size_t len = strlen(name);
+    unsigned int hash = var_hash(name, len);
+
+    /* Keep the load factor (tombstones included) at or below one half */
+    if ((store->count + store->tombstones + 1) * 2 > store->capacity &&
+        var_resize(store, store->count * 2 >= store->capacity / 2 ?
+                   store->capacity * 2 : store->capacity) == -1) {
+        return -1;
+    }
+
+    var_entry_t *slot = var_find_slot(store, name, len, hash);
+    int exists = slot->entry && slot->entry != &var_tombstone;
+
+    if (exists && (slot->flags & VAR_READONLY) && value) {
+        fprintf(stderr, "%s: readonly variable\n", name);
+        return -1;
+    }
+
+    if (value || !exists) {
+        size_t value_len = value ? strlen(value) : 0;
+        char *entry = malloc(len + value_len + 2);
+        if (!entry) {
+            perror("malloc");
+            return -1;
+        }
+
+        memcpy(entry, name, len);
+        entry[len] = value ? '=' : '\0';
+        if (value) {
+            memcpy(entry + len + 1, value, value_len + 1);
+        }
+
+        if (exists) {
+            free(slot->entry);
+        } else {
+            if (slot->entry == &var_tombstone) store->tombstones--;
+            slot->flags = 0;
+            store->count++;
+        }
+
+        slot->entry = entry;
+        slot->name_len = len;
+        slot->hash = hash;
+        slot->has_value = value != NULL;
+    }
+
+    /* Export status changes the count of envp entries */
+    int was_exported = exists && (slot->flags & VAR_EXPORT) && slot->has_value;
+    slot->flags |= flags;
+    int now_exported = (slot->flags & VAR_EXPORT) && slot->has_value;
+    store->exported += now_exported - was_exported;
+
+    if (was_exported || now_exported) {
+        store->envp_valid = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Remove a variable. Returns -1 if it is readonly.
+ */
+int var_unset(var_store_t *store, const char *name) {
+    var_entry_t *var = var_lookup(store, name);
+
+    if (!var) return 0;
+
+    if (var->flags & VAR_READONLY) {
+        fprintf(stderr, "unset: %s: cannot unset: readonly variable\n", name);
+        return -1;
+    }
+
+    if ((var->flags & VAR_EXPORT) && var->has_value) {
+        store->exported--;
+        store->envp_valid = 0;
+    }
+
+    free(var->entry);
+    var->entry = &var_tombstone;
+    store->count--;
+    store->tombstones++;
+
+    return 0;
+}
+
+/**
+ * Get the environment for execve(). The array is cached and shared by
+ * all callers until the next change to an exported variable.
+ */
+char** var_envp(var_store_t *store) {
+    if (store->envp_valid) {
+        return store->envp;
+    }
+
+    char **envp = realloc(store->envp, (store->exported + 1) * sizeof(char*));
+    if (!envp) {
+        perror("realloc");
+        return store->envp;
+    }
+    store->envp = envp;
+
+    size_t n = 0;
+    for (size_t i = 0; i < store->capacity; i++) {
+        var_entry_t *slot = &store->slots[i];
+        if (slot->entry && slot->entry != &var_tombstone &&
+            (slot->flags & VAR_EXPORT) && slot->has_value) {
+            envp[n++] = slot->entry;
+        }
+    }
+    envp[n] = NULL;
+
+    store->envp_valid = 1;
+    return envp;
+}
+
+/**
+ * Compare two entries by name for sorted listings
+ */
+static int var_entry_cmp(const void *a, const void *b) {
+    const var_entry_t *x = *(var_entry_t *const *)a;
+    const var_entry_t *y = *(var_entry_t *const *)b;
+    size_t len = x->name_len < y->name_len ? x->name_len : y->name_len;
+    int r = memcmp(x->entry, y->entry, len);
+
+    if (r != 0) return r;
+    return (x->name_len > y->name_len) - (x->name_len < y->name_len);
+}
+
+/**
+ * Print variables carrying a flag, sorted by name, as re-readable commands
+ */
+void var_print(var_store_t *store, int flag, const char *prefix) {
+    var_entry_t **list = malloc((store->count + 1) * sizeof(var_entry_t*));
+    size_t n = 0;
+
+    if (!list) {
+        perror("malloc");
+        return;
+    }
+
+    for (size_t i = 0; i < store->capacity; i++) {
+        var_entry_t *slot = &store->slots[i];
+        if (slot->entry && slot->entry != &var_tombstone && (slot->flags & flag)) {
+            list[n++] = slot;
+        }
+    }
+
+    qsort(list, n, sizeof(var_entry_t*), var_entry_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        printf("%s %s\n", prefix, list[i]->entry);
+    }
+
+    free(list);
+}
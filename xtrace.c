@@ -0,0 +1,142 @@
+#include "shell.h"
+
+/*
+ * Execution tracing for `set -x`
+ *
+ * Every command is printed to stderr with the PS4 prefix before it runs.
+ * Lines are collected in a buffer and written with one write() before
+ * anything else can write to the terminal or stderr: before the shell
+ * forks or runs a builtin (so neither a child's nor a builtin's output
+ * can overtake its trace line), before blocking for input, when the
+ * buffer fills and at exit. The lines of a whole pipeline go out in one
+ * write instead of one per word. When stderr is a terminal each line is
+ * written as soon as it is complete.
+ */
+
+#define XTRACE_BUFSIZE 65536
+#define XTRACE_PS4_DEFAULT "+ "
+
+static char xtrace_buf[XTRACE_BUFSIZE];
+static size_t xtrace_len;
+static int xtrace_registered;
+static int xtrace_unbuffered;      /* stderr is a terminal */
+
+/**
+ * Write out buffered trace lines
+ */
+void xtrace_flush(void) {
+    size_t off = 0;
+
+    while (off < xtrace_len) {
+        ssize_t n = write(STDERR_FILENO, xtrace_buf + off, xtrace_len - off);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            break; /* stderr is gone; drop the trace */
+        }
+        off += n;
+    }
+
+    xtrace_len = 0;
+}
+
+/**
+ * Append bytes to the trace buffer, flushing when it fills
+ */
+static void xtrace_append(const char *s, size_t len) {
+    while (len > 0) {
+        if (xtrace_len == XTRACE_BUFSIZE) {
+            xtrace_flush();
+        }
+
+        size_t n = XTRACE_BUFSIZE - xtrace_len;
+        if (n > len) n = len;
+        memcpy(xtrace_buf + xtrace_len, s, n);
+        xtrace_len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+/**
+ * Append a word, single-quoted if it would not read back as one word
+ */
+static void xtrace_word(const char *word) {
+    int plain = *word != '\0';
+
+    for (const char *p = word; *p && plain; p++) {
+        plain = (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                (*p >= '0' && *p <= '9') || strchr("-_./:=,+@%", *p);
+    }
+
+    if (plain) {
+        xtrace_append(word, strlen(word));
+        return;
+    }
+
+    xtrace_append("'", 1);
+    for (const char *p = word; *p; p++) {
+        if (*p == '\'') {
+            xtrace_append("'\\''", 4);
+        } else {
+            xtrace_append(p, 1);
+        }
+    }
+    xtrace_append("'", 1);
+}
+
+/**
+ * Trace one command: PS4, then the command and its arguments
+ */
+void xtrace_command(cmd_node_t *cmd, shell_context_t *ctx) {
+    const char *ps4 = var_get(ctx->vars, "PS4");
+
+    if (!cmd->command) return;
+    if (!ps4) ps4 = XTRACE_PS4_DEFAULT;
+
+    xtrace_append(ps4, strlen(ps4));
+    xtrace_word(cmd->command);
+    for (int i = 0; i < cmd->argc; i++) {
+        xtrace_append(" ", 1);
+        xtrace_word(cmd->args[i]);
+    }
+    xtrace_append("\n", 1);
+
+    if (xtrace_unbuffered) {
+        xtrace_flush();
+    }
+}
+
+/**
+ * Built-in set command: set -x / set +x, set -o / +o optimize, or print
+ * the options
+ */
+int builtin_set(char **args, shell_context_t *ctx) {
+    if (!args || !args[0]) {
+        printf("set %cx\n", ctx->xtrace ? '-' : '+');
+        printf("set %co optimize\n", ctx->optimize ? '-' : '+');
+        return 0;
+    }
+
+    for (int i = 0; args[i]; i++) {
+        if (strcmp(args[i], "-x") == 0) {
+            if (!xtrace_registered) {
+                atexit(xtrace_flush);
+                xtrace_registered = 1;
+            }
+            xtrace_unbuffered = isatty(STDERR_FILENO);
+            ctx->xtrace = 1;
+        } else if (strcmp(args[i], "+x") == 0) {
+            ctx->xtrace = 0;
+            xtrace_flush();
+        } else if ((strcmp(args[i], "-o") == 0 || strcmp(args[i], "+o") == 0) &&
+                   args[i + 1] && strcmp(args[i + 1], "optimize") == 0) {
+            ctx->optimize = args[i][0] == '-';
+            i++;
+        } else {
+            fprintf(stderr, "set: %s: invalid option\n", args[i]);
+            return 2;
+        }
+    }
+
+    return 0;
+}